@@ -0,0 +1,22 @@
+TEMPLATE = app
+TARGET = ColorBenchmark
+QT += core gui widgets
+
+#Release debugging
+#QMAKE_CXXFLAGS_RELEASE = $$QMAKE_CFLAGS_RELEASE_WITH_DEBUGINFO
+#QMAKE_LFLAGS_RELEASE = $$QMAKE_LFLAGS_RELEASE_WITH_DEBUGINFO
+
+# C++14 support
+QMAKE_CXXFLAGS += -std=c++14
+
+INCLUDEPATH += ../src/viewer
+SOURCES += main.cpp
+SOURCES += ../src/viewer/ColorLut.cpp
+SOURCES += ../src/viewer/colorManager.cpp
+SOURCES += ../src/viewer/ParallelRows.cpp
+
+LIBS += -llcms2
+unix{
+	QT += x11extras
+	LIBS += -lxcb
+}
@@ -0,0 +1,154 @@
+/*	This file is part of imgviewer, which is free software and is licensed
+ * under the terms of the GNU GPL v3.0. (see http://www.gnu.org/licenses/ ) */ 
+
+#include "colorManager.h"
+
+#include <QApplication>
+#include <QImage>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QDebug>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+inline int printError( const char* const err, int error_code=-1 ){
+	qDebug( err );
+	return error_code;
+}
+
+/** Takes ownership of 'profile' */
+static ColorProfile toColorProfile( cmsHPROFILE profile ){
+	//Go through memory, as that is how profiles normally get loaded
+	cmsUInt32Number size = 0;
+	cmsSaveProfileToMem( profile, nullptr, &size );
+	QByteArray data( size, 0 );
+	cmsSaveProfileToMem( profile, data.data(), &size );
+	cmsCloseProfile( profile );
+	
+	return ColorProfile::fromMem( data.constData(), data.size() );
+}
+
+/** A wide gamut profile with Adobe RGB primaries, so the transform is not an identity */
+static ColorProfile wideProfile(){
+	cmsCIExyY white;
+	cmsWhitePointFromTemp( &white, 6504 );
+	cmsCIExyYTRIPLE primaries{ { 0.64, 0.33, 1.0 }, { 0.21, 0.71, 1.0 }, { 0.15, 0.06, 1.0 } };
+	auto gamma = cmsBuildGamma( nullptr, 2.2 );
+	cmsToneCurve* curves[3]{ gamma, gamma, gamma };
+	auto profile = cmsCreateRGBProfile( &white, &primaries, curves );
+	cmsFreeToneCurve( gamma );
+	
+	return toColorProfile( profile );
+}
+
+static QImage noiseImage( int width, int height ){
+	QImage img( width, height, QImage::Format_ARGB32 );
+	std::mt19937 gen( 42 );
+	for( int iy=0; iy<height; iy++ ){
+		auto line = reinterpret_cast<quint32*>( img.scanLine( iy ) );
+		for( int ix=0; ix<width; ix++ )
+			line[ix] = gen() | 0xFF000000;
+	}
+	return img;
+}
+
+/** @return The fastest time out of 'trials' runs in ms */
+template<typename Transform>
+static double timeTransform( const QImage& source, const Transform& transform, int trials ){
+	double best = -1;
+	for( int i=0; i<trials; i++ ){
+		auto img = source.copy(); //Don't time the detach
+		
+		QElapsedTimer t;
+		t.start();
+		colorManager::applyTransform( img, transform );
+		double time = t.nsecsElapsed() / 1000000.0;
+		best = best < 0 ? time : std::min( best, time );
+	}
+	return best;
+}
+
+/** Prints the max and average CIEDE2000 difference between the pixels of two images in the 'profile' color space
+ *  @return The max difference */
+static double printDeltaE( const QImage& a, const QImage& b, const ColorProfile& profile ){
+	auto lab = toColorProfile( cmsCreateLab4Profile( nullptr ) );
+	auto to_lab = profile.transformTo( lab, TYPE_BGRA_8, TYPE_Lab_DBL, INTENT_RELATIVE_COLORIMETRIC );
+	
+	double max_delta = 0, total = 0;
+	std::vector<cmsCIELab> lab_a( a.width() ), lab_b( b.width() );
+	for( int iy=0; iy<a.height(); iy++ ){
+		to_lab.execute( a.constScanLine( iy ), lab_a.data(), a.width() );
+		to_lab.execute( b.constScanLine( iy ), lab_b.data(), b.width() );
+		for( int ix=0; ix<a.width(); ix++ ){
+			auto delta = cmsCIE2000DeltaE( &lab_a[ix], &lab_b[ix], 1, 1, 1 );
+			max_delta = std::max( max_delta, delta );
+			total += delta;
+		}
+	}
+	
+	qDebug() << "Delta E (CIEDE2000) max:" << max_delta << " average:" << total / ( a.width() * double(a.height()) );
+	return max_delta;
+}
+
+int main( int argc, char* argv[] ){
+	QApplication app( argc, argv );
+	auto args = app.arguments();
+	
+	if( args.size() > 3 )
+		return printError( "ColorBenchmark [IMAGE_PATH [LUT_SIZE]]" );
+	
+	auto source = args.size() >= 2 ? QImage( args[1] ) : noiseImage( 6000, 4000 );
+	unsigned lut_size = args.size() >= 3 ? args[2].toUInt() : ColorLut::default_size;
+	if( source.isNull() )
+		return printError( "Could not decode image" );
+	source = source.convertToFormat( QImage::Format_ARGB32 );
+	
+	auto from = ColorProfile::sRgb();
+	auto to = wideProfile();
+	auto transform = from.transformTo( to, TYPE_BGRA_8, TYPE_BGRA_8, INTENT_PERCEPTUAL );
+	if( !transform )
+		return printError( "Could not create transform" );
+	
+	QElapsedTimer t;
+	t.start();
+	auto float_transform = from.transformTo( to, TYPE_RGB_FLT, TYPE_RGB_FLT, INTENT_PERCEPTUAL );
+	ColorLut lut( [&]( const float* in, float* out, unsigned amount ){
+			float_transform.execute( in, out, amount );
+		}, lut_size );
+	qDebug() << "Created" << lut.gridSize() << "grid LUT in" << t.elapsed() << "ms";
+	
+	//Accuracy of the LUT compared to lcms
+	auto lcms_result = source.copy();
+	auto lut_result = source.copy();
+	colorManager::applyTransform( lcms_result, transform );
+	colorManager::applyTransform( lut_result, lut );
+	if( printDeltaE( lcms_result, lut_result, to ) > 2.0 )
+		qDebug() << "Warning: the LUT differs visibly from lcms, try a larger grid size";
+	
+	double megapixels = source.width() * double(source.height()) / 1000000;
+	qDebug() << "Image:" << source.width() << "x" << source.height();
+	
+	auto pool = QThreadPool::globalInstance();
+	int max_threads = QThread::idealThreadCount();
+	double single = 0, single_lut = 0;
+	for( int threads=1; threads<=max_threads; threads++ ){
+		pool->setMaxThreadCount( threads );
+		auto time = timeTransform( source, transform, 5 );
+		auto time_lut = timeTransform( source, lut, 5 );
+		if( threads == 1 ){
+			single = time;
+			single_lut = time_lut;
+		}
+		
+		qDebug() << "Threads:" << threads
+			<<	" lcms:" << time << "ms" << megapixels / time * 1000 << "MP/s"
+			<<	"x" << single / time
+			<<	" LUT:" << time_lut << "ms" << megapixels / time_lut * 1000 << "MP/s"
+			<<	"x" << single_lut / time_lut;
+	}
+	
+	return 0;
+}
@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = ScaleBenchmark
+QT += core gui
+
+#Release debugging
+#QMAKE_CXXFLAGS_RELEASE = $$QMAKE_CFLAGS_RELEASE_WITH_DEBUGINFO
+#QMAKE_LFLAGS_RELEASE = $$QMAKE_LFLAGS_RELEASE_WITH_DEBUGINFO
+
+# C++14 support
+QMAKE_CXXFLAGS += -std=c++14
+
+INCLUDEPATH += ../src/viewer
+SOURCES += main.cpp
+SOURCES += ../src/viewer/MipChain.cpp
+SOURCES += ../src/viewer/ParallelRows.cpp
+SOURCES += ../src/viewer/Resampler.cpp
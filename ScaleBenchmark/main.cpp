@@ -0,0 +1,88 @@
+/*	This file is part of imgviewer, which is free software and is licensed
+ * under the terms of the GNU GPL v3.0. (see http://www.gnu.org/licenses/ ) */ 
+
+#include "MipChain.hpp"
+#include "Resampler.hpp"
+
+#include <QGuiApplication>
+#include <QImage>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <QDebug>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+
+inline int printError( const char* const err, int error_code=-1 ){
+	qDebug( err );
+	return error_code;
+}
+
+static QImage noiseImage( int width, int height ){
+	QImage img( width, height, QImage::Format_RGB32 );
+	std::mt19937 gen( 42 );
+	for( int iy=0; iy<height; iy++ ){
+		auto line = reinterpret_cast<quint32*>( img.scanLine( iy ) );
+		for( int ix=0; ix<width; ix++ )
+			line[ix] = gen() | 0xFF000000;
+	}
+	return img;
+}
+
+/** @return The fastest time out of 'trials' runs in ms */
+static double timeScaling( const std::function<QImage()>& scale, int trials ){
+	double best = -1;
+	for( int i=0; i<trials; i++ ){
+		QElapsedTimer t;
+		t.start();
+		auto result = scale();
+		double time = t.nsecsElapsed() / 1000000.0;
+		best = best < 0 ? time : std::min( best, time );
+	}
+	return best;
+}
+
+int main( int argc, char* argv[] ){
+	QGuiApplication app( argc, argv );
+	auto args = app.arguments();
+	
+	if( args.size() > 2 )
+		return printError( "ScaleBenchmark [IMAGE_PATH]" );
+	
+	auto source = args.size() == 2 ? QImage( args[1] ) : noiseImage( 6000, 4000 );
+	if( source.isNull() )
+		return printError( "Could not decode image" );
+	source = source.convertToFormat( source.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32 );
+	qDebug() << "Image:" << source.width() << "x" << source.height();
+	
+	QElapsedTimer t;
+	t.start();
+	MipChain mipmaps( source );
+	qDebug() << "Mipmaps made in" << t.elapsed() << "ms";
+	
+	auto pool = QThreadPool::globalInstance();
+	int max_threads = QThread::idealThreadCount();
+	for( double scale : { 0.75, 0.5, 0.3, 0.1 } ){
+		QSize size = source.size() * scale;
+		auto& level = mipmaps.level( source, size );
+		qDebug() << "Scale:" << scale << "to" << size.width() << "x" << size.height();
+		
+		pool->setMaxThreadCount( 1 );
+		qDebug() << "  QImage::scaled          " << timeScaling( [&](){ return source.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ); }, 3 ) << "ms";
+		qDebug() << "  QImage::scaled from mip " << timeScaling( [&](){ return level.scaled( size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation ); }, 3 ) << "ms";
+		
+		for( int threads : { 1, max_threads } ){
+			pool->setMaxThreadCount( threads );
+			qDebug() << "  Threads:" << threads;
+			qDebug() << "    area                  " << timeScaling( [&](){ return resample( source, size, ResampleFilter::AREA ); }, 3 ) << "ms";
+			qDebug() << "    lanczos3              " << timeScaling( [&](){ return resample( source, size, ResampleFilter::LANCZOS3 ); }, 3 ) << "ms";
+			qDebug() << "    lanczos3 from mip     " << timeScaling( [&](){ return resample( level, size, ResampleFilter::LANCZOS3 ); }, 3 ) << "ms";
+			if( max_threads == 1 )
+				break;
+		}
+	}
+	
+	return 0;
+}
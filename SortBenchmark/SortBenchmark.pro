@@ -0,0 +1,15 @@
+TEMPLATE = app
+TARGET = SortBenchmark
+QT += core
+
+#Release debugging
+#QMAKE_CXXFLAGS_RELEASE = $$QMAKE_CFLAGS_RELEASE_WITH_DEBUGINFO
+#QMAKE_LFLAGS_RELEASE = $$QMAKE_LFLAGS_RELEASE_WITH_DEBUGINFO
+
+# C++14 support
+QMAKE_CXXFLAGS += -std=c++14
+
+INCLUDEPATH += ../src/FileSystem
+SOURCES += main.cpp
+SOURCES += ../src/FileSystem/NameCollator.cpp
+SOURCES += ../src/viewer/ParallelRows.cpp
@@ -0,0 +1,137 @@
+/*	This file is part of imgviewer, which is free software and is licensed
+ * under the terms of the GNU GPL v3.0. (see http://www.gnu.org/licenses/ ) */
+
+#include "NameCollator.hpp"
+
+#include <QCoreApplication>
+#include <QCollator>
+#include <QElapsedTimer>
+#include <QList>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+#include <QtAlgorithms>
+#include <QDebug>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <vector>
+
+inline int printError( const char* const err, int error_code=-1 ){
+	qDebug( err );
+	return error_code;
+}
+
+/** @return 'amount' names as found in photo folders, a few of them not ASCII */
+static QStringList fileNames( int amount ){
+	static const char* const patterns[] = {
+			"IMG_%1.jpg", "DSC%1.JPG", "Screenshot %1.png", "photo (%1).jpeg"
+		,	"scan-%1_final.tif", "Übersicht %1.png", "写真%1.jpg"
+		};
+	std::mt19937 gen( 42 );
+	QStringList names;
+	names.reserve( amount );
+	for( int i=0; i<amount; i++ ){
+		//Every 20th name uses one of the non-ASCII patterns
+		int pattern = i % 20 == 0 ? 5 + gen() % 2 : gen() % 5;
+		names << QString( patterns[pattern] ).arg( i, 7, 10, QChar( '0' ) );
+	}
+	std::shuffle( names.begin(), names.end(), gen );
+	return names;
+}
+
+struct CollatedFile{
+	QString name;
+	QCollatorSortKey key;
+	bool operator<( const CollatedFile& other ) const{ return key < other.key; }
+};
+
+struct KeyedFile{
+	QString name;
+	NameCollator::Key key;
+	bool operator<( const KeyedFile& other ) const{ return key < other.key; }
+};
+
+/** @return The fastest time out of 'trials' runs in ms */
+static double timeSorting( const std::function<QStringList()>& sort, int trials, QStringList& sorted ){
+	double best = -1;
+	for( int i=0; i<trials; i++ ){
+		QElapsedTimer t;
+		t.start();
+		sorted = sort();
+		double time = t.nsecsElapsed() / 1000000.0;
+		best = best < 0 ? time : std::min( best, time );
+	}
+	return best;
+}
+
+/** @return The amount of neighbours in 'sorted' the collator would order the other way */
+static int misordered( const QCollator& collator, const QStringList& sorted ){
+	int wrong = 0;
+	for( int i=1; i<sorted.size(); i++ )
+		if( collator.compare( sorted[i-1], sorted[i] ) > 0 )
+			wrong++;
+	return wrong;
+}
+
+int main( int argc, char* argv[] ){
+	QCoreApplication app( argc, argv );
+	auto args = app.arguments();
+
+	if( args.size() > 1 )
+		return printError( "SortBenchmark" );
+
+	QCollator qcollator;
+	qcollator.setNumericMode( true );
+	qcollator.setCaseSensitivity( Qt::CaseInsensitive );
+
+	QElapsedTimer t;
+	t.start();
+	NameCollator collator( qcollator );
+	qDebug() << "NameCollator made in" << t.elapsed() << "ms, fast path:" << collator.has_fast_path();
+
+	auto pool = QThreadPool::globalInstance();
+	int max_threads = QThread::idealThreadCount();
+	for( int amount : { 10000, 100000, 1000000 } ){
+		auto names = fileNames( amount );
+		int trials = amount < 1000000 ? 5 : 2;
+		qDebug() << "Names:" << amount;
+
+		QStringList sorted;
+		qDebug() << "  QCollatorSortKey, QList " << timeSorting( [&](){
+				QList<CollatedFile> files;
+				for( auto& name : names )
+					files << CollatedFile{ name, qcollator.sortKey( name ) };
+				qSort( files.begin(), files.end() );
+
+				QStringList result;
+				for( auto& file : files )
+					result << file.name;
+				return result;
+			}, trials, sorted ) << "ms";
+		qDebug() << "    misordered:" << misordered( qcollator, sorted );
+
+		for( int threads : { 1, max_threads } ){
+			pool->setMaxThreadCount( threads );
+			qDebug() << "  NameCollator, vector, threads:" << threads << timeSorting( [&](){
+					auto keys = collator.keys( names );
+					std::vector<KeyedFile> files;
+					files.reserve( names.size() );
+					for( int i=0; i<names.size(); i++ )
+						files.push_back( { names[i], std::move( keys[i] ) } );
+					std::sort( files.begin(), files.end() );
+
+					QStringList result;
+					for( auto& file : files )
+						result << file.name;
+					return result;
+				}, trials, sorted ) << "ms";
+			qDebug() << "    misordered:" << misordered( qcollator, sorted );
+			if( max_threads == 1 )
+				break;
+		}
+	}
+
+	return 0;
+}
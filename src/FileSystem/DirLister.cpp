@@ -0,0 +1,108 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DirLister.hpp"
+
+#include <QDirIterator>
+#include <QMutexLocker>
+#include <QRunnable>
+
+#include <algorithm>
+
+//Polling starts often, so the first files are available soon
+static const int first_interval = 10;
+static const int max_interval = 100;
+
+//A cancelled listing stalled on the file system still holds a thread
+static const int max_threads = 2;
+
+class ListingWorker : public QRunnable{
+	private:
+		std::function<void()> work;
+	
+	public:
+		explicit ListingWorker( std::function<void()> work ) : work( work ) { }
+		void run(){ work(); }
+};
+
+DirLister::DirLister( QObject* parent ) : QObject( parent ){
+	pool.setMaxThreadCount( max_threads );
+	connect( &poll, SIGNAL( timeout() ), this, SLOT( deliver() ) );
+}
+
+void DirLister::enumerate( QDir dir, QDir::Filters filters, bool recursive, const ExtensionChecker& filter, std::function<bool(const QString&)> found ){
+	dir.setFilter( filters );
+	
+	//This folder, or all sub-folders as well
+	auto flags = recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags;
+	QDirIterator it( dir, flags );
+	while( it.hasNext() ){
+		it.next();
+		auto file = recursive ? it.filePath() : it.fileName();
+		if( filter.matches( file ) && !found( file ) )
+			return;
+	}
+}
+
+void DirLister::list( QDir dir, QDir::Filters filters, bool recursive, ExtensionChecker filter ){
+	cancel();
+	auto current = std::make_shared<Listing>();
+	listing = current;
+	
+	//Only 'current' is used by the worker, so it doesn't matter if it is cancelled
+	pool.start( new ListingWorker( [=](){
+			enumerate( dir, filters, recursive, filter, [&]( const QString& name ){
+					QMutexLocker locker( &current->mutex );
+					current->names << name;
+					return !current->cancelled;
+				} );
+			
+			QMutexLocker locker( &current->mutex );
+			current->done = true;
+		} ) );
+	
+	poll.start( first_interval );
+}
+
+void DirLister::cancel(){
+	if( listing )
+		listing->cancelled = true;
+	listing.reset();
+	poll.stop();
+}
+
+void DirLister::deliver(){
+	if( !listing )
+		return;
+	
+	QStringList names;
+	bool done;
+	{	QMutexLocker locker( &listing->mutex );
+		names.swap( listing->names );
+		done = listing->done;
+	}
+	
+	if( done )
+		cancel();
+	else
+		poll.setInterval( std::min( poll.interval() * 2, max_interval ) );
+	
+	if( !names.isEmpty() )
+		emit found( names );
+	if( done )
+		emit finished();
+}
@@ -0,0 +1,80 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DIR_LISTER_HPP
+#define DIR_LISTER_HPP
+
+#include "ExtensionChecker.hpp"
+
+#include <QObject>
+#include <QDir>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/*
+	Lists the supported files of a directory in a worker thread, and passes
+	them on in batches as they are found, so the first ones can be used
+	before it completes. The names found are collected at short intervals,
+	which grow to 100 ms, so a huge directory does not mean a huge amount of
+	batches while a stalled one still shows what it found.
+	A cancelled listing is left to finish on its own, as a stalled file
+	system could otherwise block the caller. Listings run in their own
+	small pool, so stalled ones can't occupy the global QThreadPool.
+*/
+class DirLister : public QObject{
+	Q_OBJECT
+	
+	private:
+		//Shared with the worker, which might outlive this object
+		struct Listing{
+			QMutex mutex;
+			QStringList names; //Found, but not passed on yet
+			bool done{ false };
+			std::atomic<bool> cancelled{ false };
+		};
+		std::shared_ptr<Listing> listing;
+		QTimer poll;
+		QThreadPool pool; //Only for listings, its workers only use their Listing
+	
+	public:
+		explicit DirLister( QObject* parent = nullptr );
+		~DirLister(){ cancel(); }
+		
+		/** Calls 'found' for each supported file, named relative to 'dir', or with the full path if 'recursive'. Stops if it returns false */
+		static void enumerate( QDir dir, QDir::Filters filters, bool recursive, const ExtensionChecker& filter, std::function<bool(const QString&)> found );
+		
+		/** Starts listing 'dir' in the background, cancelling what it was listing before */
+		void list( QDir dir, QDir::Filters filters, bool recursive, ExtensionChecker filter );
+		void cancel();
+		bool is_listing() const{ return listing != nullptr; }
+	
+	private slots:
+		void deliver();
+	
+	signals:
+		void found( QStringList names );
+		void finished();
+};
+
+
+#endif
@@ -0,0 +1,175 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DirWatcher.hpp"
+
+#include <QFile>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+	#include <sys/inotify.h>
+	#include <unistd.h>
+#endif
+
+DirWatcher::DirWatcher( QObject* parent ) : QObject( parent ){
+	flush_timer.setSingleShot( true );
+	flush_timer.setInterval( 200 );
+	connect( &flush_timer, SIGNAL( timeout() ), this, SLOT( flush() ) );
+	connect( &fallback, SIGNAL( directoryChanged( QString ) ), this, SLOT( directory_changed() ) );
+
+#ifdef Q_OS_LINUX
+	inotify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+	if( inotify >= 0 ){
+		notifier = new QSocketNotifier( inotify, QSocketNotifier::Read, this );
+		connect( notifier, SIGNAL( activated( int ) ), this, SLOT( read_events() ) );
+	}
+	else
+		qWarning( "inotify not available, listing the directory again on changes" );
+#endif
+}
+
+DirWatcher::~DirWatcher(){
+#ifdef Q_OS_LINUX
+	if( inotify >= 0 )
+		close( inotify );
+#endif
+}
+
+void DirWatcher::watch( QString directory ){
+	if( directory == path )
+		return;
+	clear();
+	path = directory;
+
+#ifdef Q_OS_LINUX
+	if( inotify >= 0 ){
+		auto mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+		watch_id = inotify_add_watch( inotify, QFile::encodeName( path ).constData(), mask );
+		if( watch_id >= 0 )
+			return;
+	}
+#endif
+	fallback.addPath( path );
+}
+
+void DirWatcher::clear(){
+#ifdef Q_OS_LINUX
+	if( watch_id >= 0 )
+		inotify_rm_watch( inotify, watch_id );
+#endif
+	watch_id = -1;
+	if( !fallback.directories().isEmpty() )
+		fallback.removePaths( fallback.directories() );
+	
+	path = "";
+	flush_timer.stop();
+	pending.clear();
+	rescan = false;
+	created.clear();
+	moved_from.clear();
+}
+
+void DirWatcher::add( Change change ){
+	//Files are often closed several times while being written
+	bool repeated = !pending.empty() && change.type == Change::ADDED
+		&&	pending.back().type == Change::ADDED && pending.back().name == change.name;
+	if( !repeated )
+		pending.push_back( change );
+	flush_timer.start();
+}
+
+void DirWatcher::directory_changed(){
+	rescan = true;
+	flush_timer.start();
+}
+
+void DirWatcher::read_events(){
+#ifdef Q_OS_LINUX
+	alignas( inotify_event ) char buffer[4096];
+	ssize_t length;
+	while( ( length = read( inotify, buffer, sizeof(buffer) ) ) > 0 ){
+		for( char* pos = buffer; pos < buffer + length; ){
+			auto& event = *reinterpret_cast<const inotify_event*>( pos );
+			pos += sizeof(inotify_event) + event.len;
+			
+			if( event.mask & IN_Q_OVERFLOW ){
+				directory_changed();
+				continue;
+			}
+			if( event.wd != watch_id )
+				continue; //From a directory no longer watched
+			
+			//Directories are not shown, but the files in them might be
+			if( event.mask & ( IN_ISDIR | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED ) ){
+				directory_changed();
+				continue;
+			}
+			
+			auto name = QFile::decodeName( event.name );
+			if( event.mask & IN_CREATE ){
+				created.insert( name );
+				flush_timer.start();
+			}
+			if( event.mask & IN_MODIFY )
+				created.remove( name ); //Being written, wait on the writer to close it
+			if( event.mask & IN_CLOSE_WRITE ){
+				created.remove( name );
+				add( { Change::ADDED, name, {} } );
+			}
+			if( event.mask & IN_DELETE ){
+				created.remove( name );
+				add( { Change::REMOVED, name, {} } );
+			}
+			if( event.mask & IN_MOVED_FROM ){
+				created.remove( name );
+				moved_from[event.cookie] = name;
+				flush_timer.start();
+			}
+			if( event.mask & IN_MOVED_TO ){
+				auto from = moved_from.find( event.cookie );
+				if( from != moved_from.end() ){
+					add( { Change::RENAMED, from->second, name } );
+					moved_from.erase( from );
+				}
+				else //Moved here from another directory
+					add( { Change::ADDED, name, {} } );
+			}
+		}
+	}
+#endif
+}
+
+void DirWatcher::flush(){
+	//Not written to, such as links, so there is no close to wait on
+	for( auto& name : created )
+		pending.push_back( { Change::ADDED, name, {} } );
+	created.clear();
+	
+	//Moved to another directory
+	for( auto& from : moved_from )
+		pending.push_back( { Change::REMOVED, from.second, {} } );
+	moved_from.clear();
+	
+	auto changes = std::move( pending );
+	pending.clear();
+	if( rescan ){
+		rescan = false;
+		emit rescan_needed();
+	}
+	else if( !changes.empty() )
+		emit changed( changes );
+}
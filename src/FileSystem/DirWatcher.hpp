@@ -0,0 +1,91 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DIR_WATCHER_HPP
+#define DIR_WATCHER_HPP
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+class QSocketNotifier;
+
+/*
+	Watches a directory for files being added, removed and renamed.
+	On Linux inotify tells exactly what changed, so the file list can be
+	updated without listing the directory again. New files which are
+	written to are only reported once the writer has closed them, files
+	which never are (such as links) once the changes are passed on.
+	Elsewhere, or if events
+	were lost, it only tells that the directory needs to be listed again.
+	Changes are collected until none have arrived for set_delay() ms.
+*/
+class DirWatcher : public QObject{
+	Q_OBJECT
+	
+	public:
+		struct Change{
+			enum Type{
+				ADDED, //Or written again
+				REMOVED,
+				RENAMED
+			} type;
+			QString name; //Relative to the directory
+			QString to;   //The new name, if renamed
+		};
+	
+	private:
+		QString path;
+		QTimer flush_timer;
+		std::vector<Change> pending;
+		bool rescan{ false };
+		void add( Change change );
+		
+		QFileSystemWatcher fallback; //When inotify is not available
+		
+		int inotify{ -1 };
+		int watch_id{ -1 };
+		QSocketNotifier* notifier{ nullptr };
+		QSet<QString> created; //Created, but not written to yet
+		std::map<uint32_t,QString> moved_from; //Keyed by cookie, for matching it with where it was moved to
+	
+	public:
+		explicit DirWatcher( QObject* parent = nullptr );
+		~DirWatcher();
+		
+		void set_delay( int ms ){ flush_timer.setInterval( ms ); }
+		void watch( QString directory );
+		void clear();
+	
+	private slots:
+		void read_events();
+		void directory_changed();
+		void flush();
+	
+	signals:
+		void changed( std::vector<DirWatcher::Change> changes );
+		void rescan_needed();
+};
+
+
+#endif
@@ -0,0 +1,208 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "NameCollator.hpp"
+
+#include "../viewer/ParallelRows.hpp"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+using namespace std;
+
+//The characters handled by the fast path
+static const ushort first_printable = 0x20;
+static const ushort last_printable  = 0x7E;
+
+//Byte values in fast keys, ranks start above them
+static const char level_separator = 1;
+static const unsigned char first_rank = 2;
+
+//A digit run stores its length in a byte
+static const int max_digits = 254;
+
+inline bool isDigit( ushort c ){ return c >= '0' && c <= '9'; }
+inline int sign( int value ){ return (value > 0) - (value < 0); }
+
+static int compareBytes( const QByteArray& a, const QByteArray& b ){
+	int result = memcmp( a.constData(), b.constData(), min( a.size(), b.size() ) );
+	return result != 0 ? result : a.size() - b.size();
+}
+
+
+int NameCollator::Key::compare( const Key& other ) const{
+	if( !sorted && !other.sorted )
+		return compareBytes( fast, other.fast );
+	if( sorted && other.sorted )
+		return sorted->compare( *other.sorted );
+	
+	//One of each, only the collator knows how they compare
+	return collator->compare( name, other.name );
+}
+
+
+NameCollator::NameCollator( QCollator collator, bool log ) : collator( collator ), log( log ){
+	build_tables();
+	
+	//This also sets up the collator, which must not happen lazily once keys are made in parallel
+	fast_path = self_test();
+	if( log )
+		qDebug( "Name collation: %s", fast_path ? "table for ASCII names" : "collator only" );
+}
+
+/* Finds the order of the printable ASCII characters by asking the collator */
+void NameCollator::build_tables(){
+	case_sensitive = collator.caseSensitivity() == Qt::CaseSensitive;
+	numeric = collator.numericMode();
+	fill( begin(ranks), end(ranks), 0 );
+	fill( begin(cases), end(cases), 0 );
+	
+	//Characters equal when ignoring case share a rank, the case is compared afterwards
+	QCollator primary( collator );
+	primary.setCaseSensitivity( Qt::CaseInsensitive );
+	auto less = [&]( const QString& a, const QString& b ){ return primary.compare( a, b ) < 0; };
+	
+	QStringList visible;
+	for( ushort c=first_printable; c<=last_printable; c++ ){
+		auto str = QString( QChar( c ) );
+		//Compared after a letter, as some collators handle empty strings separately
+		if( primary.compare( "a" + str, "a" ) != 0 )
+			visible << str;
+	}
+	stable_sort( visible.begin(), visible.end(), less );
+	
+	int rank = first_rank;
+	for( int i=0; i<visible.size(); i++ ){
+		if( i > 0 && less( visible[i-1], visible[i] ) )
+			rank++;
+		ranks[ visible[i][0].unicode() ] = rank;
+	}
+	
+	if( case_sensitive )
+		for( ushort lower='a'; lower<='z'; lower++ ){
+			ushort upper = lower - 'a' + 'A';
+			bool lower_first = collator.compare( QString( QChar( lower ) ), QString( QChar( upper ) ) ) < 0;
+			cases[lower] = lower_first ? 2 : 3;
+			cases[upper] = lower_first ? 3 : 2;
+		}
+}
+
+/** @return true if the fast keys order a set of short names the same as the collator */
+bool NameCollator::self_test() const{
+	QStringList probes;
+	QString alphanumeric;
+	for( ushort c=first_printable; c<=last_printable; c++ ){
+		QChar ch( c );
+		probes << QString( ch );
+		if( ch.isLetterOrNumber() )
+			alphanumeric += ch;
+		else
+			probes << QString( "a" ) + ch + "b";
+	}
+	
+	//Catches contractions, such as "ch" in Czech or "aa" in Danish
+	for( auto first : alphanumeric )
+		for( auto second : alphanumeric )
+			probes << QString( first ) + second;
+	
+	sort( probes.begin(), probes.end(), [&]( const QString& a, const QString& b ){ return collator.compare( a, b ) < 0; } );
+	
+	//Neighbours must compare the same, then the orders are identical
+	QByteArray previous, current;
+	fast_key( probes[0], previous );
+	for( int i=1; i<probes.size(); i++ ){
+		fast_key( probes[i], current );
+		if( sign( compareBytes( previous, current ) ) != sign( collator.compare( probes[i-1], probes[i] ) ) ){
+			if( log )
+				qDebug( "Name collation: '%s' and '%s' can't be ordered by table", qPrintable( probes[i-1] ), qPrintable( probes[i] ) );
+			return false;
+		}
+		swap( previous, current );
+	}
+	return true;
+}
+
+/** @return false if 'name' must use the collator, 'key' is then unusable */
+bool NameCollator::fast_key( const QString& name, QByteArray& key ) const{
+	auto data = name.constData();
+	int size = name.size();
+	
+	key.clear();
+	key.reserve( size * 2 + 1 );
+	QByteArray case_level;
+	
+	for( int i=0; i<size; i++ ){
+		auto c = data[i].unicode();
+		if( c < first_printable || c > last_printable )
+			return false;
+		if( ranks[c] == 0 )
+			continue;
+		
+		if( numeric && isDigit( c ) ){
+			//Ordered by amount of digits first, leading zeros don't count
+			int end = i;
+			while( end < size && isDigit( data[end].unicode() ) )
+				end++;
+			while( i+1 < end && data[i].unicode() == '0' )
+				i++;
+			if( end - i > max_digits )
+				return false;
+			
+			key += char( ranks['0'] );
+			key += char( end - i + 1 );
+			for( ; i<end; i++ )
+				key += char( data[i].unicode() - '0' + first_rank );
+			i--;
+			continue;
+		}
+		
+		key += char( ranks[c] );
+		if( cases[c] )
+			case_level += char( cases[c] );
+	}
+	
+	//Case only matters if everything else is equal
+	if( case_sensitive ){
+		key += level_separator;
+		key += case_level;
+	}
+	return true;
+}
+
+NameCollator::Key NameCollator::key( const QString& name ) const{
+	Key key;
+	key.collator = this;
+	key.name = name;
+	if( !fast_path || !fast_key( name, key.fast ) ){
+		key.fast.clear();
+		key.sorted = make_shared<const QCollatorSortKey>( collator.sortKey( name ) );
+	}
+	return key;
+}
+
+std::vector<NameCollator::Key> NameCollator::keys( const QStringList& names ) const{
+	vector<Key> made( names.size() );
+	//Each name is a row, roughly the size of a key
+	parallelRows( names.size(), 64, [&]( int first, int last ){
+			for( int i=first; i<last; i++ )
+				made[i] = key( names[i] );
+		} );
+	return made;
+}
@@ -0,0 +1,81 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NAME_COLLATOR_HPP
+#define NAME_COLLATOR_HPP
+
+#include <QByteArray>
+#include <QCollator>
+#include <QString>
+#include <QStringList>
+
+#include <memory>
+#include <vector>
+
+/*
+	Sort keys for file names, ordered the same as by a QCollator. Names of
+	printable ASCII get a key made from a table of how the collator orders
+	each character, which is compared with memcmp(). Digit runs are encoded
+	by their amount of digits first, for natural number order. Other names,
+	or all of them if the table can't reproduce the collator (for example
+	locales where "ch" sorts as a single letter), use QCollatorSortKey.
+*/
+class NameCollator{
+	public:
+		class Key{
+			friend class NameCollator;
+			private:
+				const NameCollator* collator{ nullptr };
+				QString name;
+				QByteArray fast; //Used if 'sorted' is not set
+				std::shared_ptr<const QCollatorSortKey> sorted;
+			
+			public:
+				Key() { }
+				
+				int compare( const Key& other ) const;
+				bool operator<( const Key& other ) const{ return compare( other ) < 0; }
+		};
+	
+	private:
+		QCollator collator;
+		bool fast_path{ false };
+		bool log; //Tell which path is used, and why the fast one isn't
+		bool case_sensitive;
+		bool numeric;
+		unsigned char ranks[128]; //Primary order of each character, 0 if ignored
+		unsigned char cases[128]; //Order of the case of letters, 0 for other characters
+		
+		void build_tables();
+		bool self_test() const;
+		bool fast_key( const QString& name, QByteArray& key ) const;
+	
+	public:
+		explicit NameCollator( QCollator collator, bool log = false );
+		
+		/** @return true if ASCII names avoid the collator */
+		bool has_fast_path() const{ return fast_path; }
+		
+		int compare( const QString& a, const QString& b ) const{ return collator.compare( a, b ); }
+		
+		Key key( const QString& name ) const;
+		/** Makes the keys for all of 'names' on the global QThreadPool */
+		std::vector<Key> keys( const QStringList& names ) const;
+};
+
+
+#endif
@@ -18,6 +18,7 @@
 #include "AnimCombiner.hpp"
 
 #include <stdexcept>
+#include <QColor>
 #include <QPainter>
 #include <QDebug>
 
@@ -132,27 +133,37 @@ QImage AnimCombiner::combineIndexed( QImage new_image, int x, int y, BlendMode b
 }
 
 QImage AnimCombiner::combine( QImage new_image, int x, int y, BlendMode blend, DisposeMode dispose, IndexColor transparent ){
-	if( previous.isNull() ){
+	bool first = previous.isNull();
+	if( first ){
 		previous = QImage( new_image.size(), new_image.format() );
 		previous.setColorTable( new_image.colorTable() );
-		previous.fill( isIndexed(previous) ? background_color.getIndexed() : background_color.getRgb() );
+		if( isIndexed( previous ) )
+			previous.fill( background_color.getIndexed() );
+		else
+			previous.fill( QColor::fromRgba( background_color.getRgb() ) );
 	}
 	
+	//Besides the new image, what the last frame disposed of changes as well
+	QRect canvas( {0,0}, previous.size() );
+	QRect area( {x,y}, new_image.size() );
+	changed = first ? canvas : ( area | disposed ) & canvas;
+	disposed = dispose == DisposeMode::NONE ? QRect() : area;
+	
 	//Try to see if we can merge it indexed
 	auto tryIndexed = combineIndexed( new_image, x, y, blend, dispose, transparent );
 	if( !tryIndexed.isNull() )
 		return tryIndexed;
 	
-	//QPainter can't handle indexed images, convert to something it can handle
+	//QPainter can't handle indexed images, convert to something it can handle.
+	//Premultiplied is the format QPainter composites fastest, and the viewer draws fastest
 	auto fixFormat = []( QImage& img, IndexColor transparent={} ){
-			if( isIndexed( img ) ){
-				if( transparent.hasIndex() && transparent.getIndexed() >= 0 ){
-					auto palette = img.colorTable();
-					palette[transparent.getIndexed()] = qRgba(0,0,0,0);
-					img.setColorTable( palette );
-				}
-				img = img.convertToFormat( QImage::Format_ARGB32 );
+			if( isIndexed( img ) && transparent.hasIndex() && transparent.getIndexed() >= 0 ){
+				auto palette = img.colorTable();
+				palette[transparent.getIndexed()] = qRgba(0,0,0,0);
+				img.setColorTable( palette );
 			}
+			if( isIndexed( img ) || img.format() == QImage::Format_ARGB32 )
+				img = img.convertToFormat( QImage::Format_ARGB32_Premultiplied );
 		};
 	fixFormat( new_image, transparent );
 	fixFormat( previous );
@@ -170,7 +181,7 @@ QImage AnimCombiner::combine( QImage new_image, int x, int y, BlendMode blend, D
 				previous = output;
 				QPainter canvas_painter( &previous );
 				canvas_painter.setCompositionMode( QPainter::CompositionMode_Source );
-				canvas_painter.fillRect( x, y, new_image.width(), new_image.height(), background_color.getRgb() );
+				canvas_painter.fillRect( x, y, new_image.width(), new_image.height(), QColor::fromRgba( background_color.getRgb() ) );
 			} break;
 		case DisposeMode::REVERT: break;
 	}
@@ -19,6 +19,7 @@
 #define ANIM_COMBINER_HPP
 
 #include <QImage>
+#include <QRect>
 
 enum class BlendMode{
 	REPLACE,
@@ -51,12 +52,15 @@ class AnimCombiner{
 	private:
 		QImage previous;
 		IndexColor background_color;
+		QRect changed;  //The area of the last frame which differs from the frame before it
+		QRect disposed; //The area the last frame disposes of, which changes in the next frame
 		
 		QImage combineIndexed( QImage new_image, int x, int y, BlendMode blend, DisposeMode dispose, IndexColor transparent );
 		
 	public:
 		AnimCombiner( QImage previous ) : previous(previous) { }
 		QImage combine( QImage new_image, int x, int y, BlendMode blend, DisposeMode dispose, IndexColor transparent = {} );
+		QRect changedArea() const{ return changed; }
 		
 		void setBackgroundColor( IndexColor background )
 			{ background_color = background; }
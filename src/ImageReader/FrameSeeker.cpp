@@ -0,0 +1,83 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameSeeker.hpp"
+
+using namespace std;
+
+FrameSeeker::FrameSeeker( const vector<AnimFrameInfo>& frames, QSize canvas, AnimCombiner start )
+	:	keyframes( frames.size() ), done( frames.size(), false ), start( start ), current{ 0, start } {
+	for( unsigned i=0; i<frames.size(); i++ ){
+		//It must replace the entire canvas, and leave only itself for the next frame
+		auto& frame = frames[i];
+		keyframes[i] = i == 0 || (
+				frame.area == QRect( {0,0}, canvas )
+			&&	( frame.blend == BlendMode::REPLACE || frame.opaque )
+			&&	frame.dispose != DisposeMode::REVERT
+			);
+	}
+}
+
+void FrameSeeker::switchTo( Branch branch ){
+	if( !isDone( current.next ) )
+		paused.push_back( current );
+	current = branch;
+}
+
+int FrameSeeker::next( int wanted ){
+	if( wanted >= 0 && !isDone( wanted ) ){
+		int keyframe = wanted;
+		while( !keyframes[keyframe] )
+			keyframe--;
+		
+		//A branch reaches 'wanted' if it is past the keyframe, and the frames until it are not combined
+		auto reaches = [&]( int from ){
+				if( from < keyframe || from > wanted )
+					return false;
+				for( int i=from; i<wanted; i++ )
+					if( done[i] )
+						return false;
+				return true;
+			};
+		
+		if( !reaches( current.next ) ){
+			auto best = paused.end();
+			for( auto it = paused.begin(); it != paused.end(); ++it )
+				if( reaches( it->next ) && ( best == paused.end() || it->next > best->next ) )
+					best = it;
+			
+			if( best != paused.end() ){
+				auto branch = *best;
+				paused.erase( best );
+				switchTo( branch );
+			}
+			else if( !isDone( keyframe ) )
+				switchTo( { keyframe, start } );
+		}
+	}
+	
+	//Continue a paused branch when this one reaches frames which are combined already
+	while( isDone( current.next ) ){
+		if( paused.empty() )
+			return -1;
+		current = paused.back();
+		paused.pop_back();
+	}
+	
+	done[current.next] = true;
+	return current.next++;
+}
@@ -0,0 +1,72 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAME_SEEKER_HPP
+#define FRAME_SEEKER_HPP
+
+#include "AnimCombiner.hpp"
+
+#include <QRect>
+#include <QSize>
+
+#include <vector>
+
+/** What is known about a frame before combining it */
+struct AnimFrameInfo{
+	QRect area;
+	BlendMode blend;
+	DisposeMode dispose;
+	bool opaque; //Covers everything below it
+};
+
+/*
+	Decides the order animation frames are combined in, so a frame far ahead
+	can be shown without combining every frame before it first.
+	Keyframes are frames which do not depend on the frames before them, a
+	seek jumps to the keyframe before the wanted frame. The frames skipped
+	are combined afterwards, continuing where it left off.
+*/
+class FrameSeeker{
+	private:
+		struct Branch{
+			int next; //The frame to combine next
+			AnimCombiner combiner;
+		};
+		
+		std::vector<bool> keyframes;
+		std::vector<bool> done;
+		AnimCombiner start; //The state before the first frame
+		Branch current;
+		std::vector<Branch> paused; //Left by seeking
+		
+		bool isDone( int index ) const{ return index >= (int)done.size() || done[index]; }
+		void switchTo( Branch branch );
+	
+	public:
+		/** 'canvas' is the size of the first frame, which the combiner uses for the canvas */
+		FrameSeeker( const std::vector<AnimFrameInfo>& frames, QSize canvas, AnimCombiner start );
+		
+		bool isKeyframe( int index ) const{ return keyframes[index]; }
+		
+		/** @return The frame to combine next, or -1 when all are. Seeks if 'wanted' is not combined yet */
+		int next( int wanted=-1 );
+		/** The combiner to combine the frame returned by next() with */
+		AnimCombiner& combiner(){ return current.combiner; }
+};
+
+
+#endif
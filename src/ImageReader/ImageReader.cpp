@@ -35,7 +35,27 @@ ImageReader::ImageReader(){
 			formats.insert( std::make_pair( ext.toLower(), reader.get() ) );
 }
 
+bool ImageReader::readFile( QString filepath, QByteArray& data ){
+	QFile file( filepath );
+	if( !file.open( QIODevice::ReadOnly ) )
+		return false;
+	
+	data = file.readAll();
+	return true;
+}
+
 AReader::Error ImageReader::read( imageCache &cache, QString filepath ) const{
+	QByteArray data;
+	if( !readFile( filepath, data ) ){
+		cache.url = QUrl::fromLocalFile( filepath );
+		cache.set_status( imageCache::EMPTY );
+		return AReader::ERROR_NO_FILE;
+	}
+	
+	return read( cache, filepath, data );
+}
+
+AReader::Error ImageReader::read( imageCache &cache, QString filepath, const QByteArray& data ) const{
 	QString ext = QFileInfo(filepath).suffix().toLower();
 	
 	AReader* reader = nullptr;
@@ -45,17 +65,7 @@ AReader::Error ImageReader::read( imageCache &cache, QString filepath ) const{
 	else
 		return AReader::ERROR_TYPE_UNKNOWN;
 	
-	QFile file( filepath );
 	cache.url = QUrl::fromLocalFile( filepath );
-	QByteArray data;
-	if( file.open( QIODevice::ReadOnly ) ){
-		data = file.readAll();
-		file.close();
-	}
-	else{
-		cache.set_status( imageCache::EMPTY );
-		return AReader::ERROR_NO_FILE;
-	}
 	
 	auto u_data = reinterpret_cast<const uint8_t*>( data.constData() );
 	AReader::Error err = reader->read( cache, u_data, data.size(), ext );
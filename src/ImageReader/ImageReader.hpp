@@ -19,6 +19,7 @@
 #define IMAGE_READER_HPP
 
 #include <QString>
+#include <QByteArray>
 #include <vector>
 #include <map>
 #include <memory>
@@ -33,6 +34,9 @@ class ImageReader{
 		ImageReader();
 		
 		AReader::Error read( imageCache &cache, QString filepath ) const;
+		AReader::Error read( imageCache &cache, QString filepath, const QByteArray& data ) const;
+		
+		static bool readFile( QString filepath, QByteArray& data );
 		
 		QList<QString> supportedExtensions() const;
 };
@@ -19,6 +19,7 @@
 
 #include "ReaderGif.hpp"
 #include "AnimCombiner.hpp"
+#include "FrameSeeker.hpp"
 
 #include <QImage>
 #include <QPainter>
@@ -122,15 +123,35 @@ AReader::Error ReaderGif::read( imageCache &cache, const uint8_t* data, unsigned
 	//TODO: default color if no global map?
 	combiner.setBackgroundColor( { gif->SBackGroundColor, global_palette } );
 	
+	//Index the frames before combining them, so it can seek to the frames which do not need the ones before them
+	std::vector<GraphicsControlBlock> controls( gif->ImageCount );
+	std::vector<AnimFrameInfo> frames;
+	frames.reserve( gif->ImageCount );
 	for( int i=0; i<gif->ImageCount; i++ ){
+		auto& gcb = controls[i];
+		if( DGifSavedExtensionToGCB( gif, i, &gcb ) != GIF_OK )
+			qDebug( "Did not contain stuff" );
+		
+		auto desc = gif->SavedImages[i].ImageDesc;
+		auto raster = gif->SavedImages[i].RasterBits;
+		bool opaque = gcb.TransparentColor < 0
+			||	!std::memchr( raster, gcb.TransparentColor, desc.Width * desc.Height );
+		frames.push_back( { { desc.Left, desc.Top, desc.Width, desc.Height }, BlendMode::OVERLAY, gifDispose( &gcb ), opaque } );
+	}
+	
+	//The combiner makes the canvas the size of the first frame
+	QSize canvas;
+	if( gif->ImageCount > 0 )
+		canvas = { gif->SavedImages[0].ImageDesc.Width, gif->SavedImages[0].ImageDesc.Height };
+	FrameSeeker seeker( frames, canvas, combiner );
+	
+	for( int i=seeker.next(); i>=0; i=seeker.next( cache.requested_frame() ) ){
 		//qDebug( "Local color map: %p", gif->SavedImages[i].ImageDesc.ColorMap );
 		auto saved = gif->SavedImages[i];
 		auto img = convertImage( saved.ImageDesc, saved.RasterBits, gif->SColorMap );
 		
-		GraphicsControlBlock gcb;
-		if( DGifSavedExtensionToGCB( gif, i, &gcb ) != GIF_OK )
-			qDebug( "Did not contain stuff" );
-		auto dispose = gifDispose( &gcb ); //TODO: If none
+		auto& gcb = controls[i];
+		auto dispose = frames[i].dispose; //TODO: If none
 		
 		auto delay = gcb.DelayTime * 10;
 		delay = (delay == 0) ? 100 : delay; //TODO: replace with constant
@@ -141,7 +162,8 @@ AReader::Error ReaderGif::read( imageCache &cache, const uint8_t* data, unsigned
 		auto transparent = IndexColor( gcb.TransparentColor, palette );
 		//TODO: check for -1
 		
-		cache.add_frame( combiner.combine( img, saved.ImageDesc.Left, saved.ImageDesc.Top, BlendMode::OVERLAY, dispose, transparent ), delay );
+		auto frame = seeker.combiner().combine( img, saved.ImageDesc.Left, saved.ImageDesc.Top, BlendMode::OVERLAY, dispose, transparent );
+		cache.set_frame( i, frame, delay, seeker.combiner().changedArea() );
 	}
 	
 	//Clean up
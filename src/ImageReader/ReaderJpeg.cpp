@@ -145,7 +145,7 @@ AReader::Error ReaderJpeg::read( imageCache &cache, const uint8_t* data, unsigne
 		for( auto marker = jpeg.cinfo.marker_list; marker; marker = marker->next ){
 			//Check for and read ICC profile
 			if( ICC_META_TEST.validate( marker ) ){
-				cache.set_profile( ColorProfile::fromMem(
+				cache.set_profile( cache.get_manager()->profileFromMem(
 						marker->data        + ICC_META_TEST.length
 					,	marker->data_length - ICC_META_TEST.length
 					) );
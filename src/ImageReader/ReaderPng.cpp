@@ -124,6 +124,10 @@ static void readRgb( PngInfo& info, unsigned width, unsigned height, bool update
 	//Initialize image
 	auto format = alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
 	info.read( width, height, format, update );
+	
+	//Premultiplied images can be drawn without converting them each time
+	if( alpha )
+		info.frame = std::move( info.frame ).convertToFormat( QImage::Format_ARGB32_Premultiplied );
 }
 
 #if QT_VERSION >= 0x050500
@@ -168,7 +172,7 @@ static void readAnimated( imageCache &cache, PngInfo& png ){
 	png_uint_16 delay_num=0, delay_den=0;
 	png_byte dispose_op = PNG_DISPOSE_OP_NONE, blend_op = PNG_BLEND_OP_SOURCE;
 	
-	QImage canvas( width, height, QImage::Format_ARGB32 );
+	QImage canvas( width, height, QImage::Format_ARGB32_Premultiplied );
 	canvas.fill( qRgba( 0,0,0,0 ) );
 	AnimCombiner combiner( canvas );
 	
@@ -219,7 +223,7 @@ static void readAnimated( imageCache &cache, PngInfo& png ){
 				default: return DisposeMode::NONE; //TODO: add error
 			} }();
 		QImage output = combiner.combine( png.frame, x_offset, y_offset, blend_mode, dispose_mode );
-		cache.add_frame( output, delay );
+		cache.add_frame( output, delay, combiner.changedArea() );
 	}
 }
 #endif
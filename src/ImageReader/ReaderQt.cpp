@@ -22,6 +22,8 @@
 #include <QImageReader>
 #include <QBuffer>
 
+#include <memory>
+
 QList<QString> ReaderQt::extensions() const{
 	QList<QString> exts;
 	for( auto extension : QImageReader::supportedImageFormats() )
@@ -29,33 +31,75 @@ QList<QString> ReaderQt::extensions() const{
 	return exts;
 }
 
+static const qint64 stream_budget = 256 * 1024 * 1024; //Bytes of frames kept for animations decoded while shown
+
 static QByteArray fromData( const uint8_t* data, unsigned length )
 	{ return QByteArray( reinterpret_cast<const char*>( data ), length ); }
 
+/* Keeps the QImageReader and the data it reads from, so the frames can be decoded later */
+class QtFrameSource : public FrameSource{
+	private:
+		QByteArray data;
+		QByteArray format;
+		QBuffer buffer;
+		std::unique_ptr<QImageReader> image_reader;
+	
+	public:
+		QtFrameSource( QByteArray data, QByteArray format )
+			:	data( data ), format( format ), buffer( &this->data ) { restart(); }
+		
+		QImageReader& reader(){ return *image_reader; }
+		
+		bool restart() override{
+			buffer.close();
+			image_reader = std::make_unique<QImageReader>( &buffer, format );
+			return image_reader->canRead();
+		}
+		
+		bool read( QImage& frame, int& delay ) override{
+			if( !image_reader->read( &frame ) )
+				return false;
+			
+			//Premultiplied images can be drawn without converting them each time
+			if( frame.format() == QImage::Format_ARGB32 )
+				frame = std::move( frame ).convertToFormat( QImage::Format_ARGB32_Premultiplied );
+			delay = image_reader->nextImageDelay();
+			image_reader->jumpToNextImage();
+			return true;
+		}
+};
+
 AReader::Error ReaderQt::read( imageCache &cache, const uint8_t* data, unsigned length, QString format ) const{
-	QByteArray byte_data = fromData( data, length );
-	QBuffer buffer( &byte_data );
-	QImageReader image_reader( &buffer, format.toLocal8Bit() );
+	auto source = std::make_unique<QtFrameSource>( fromData( data, length ), format.toLocal8Bit() );
+	auto& image_reader = source->reader();
 	
 	if( image_reader.canRead() ){
 		//Read first image
 		QImage frame;
-		if( !image_reader.read( &frame ) )
+		int delay;
+		if( !source->read( frame, delay ) )
 			return ERROR_TYPE_UNKNOWN;
 		
 		int frame_amount = image_reader.imageCount();
 		auto isAnim = image_reader.supportsAnimation();
 		cache.set_info( frame_amount, isAnim, isAnim ? image_reader.loopCount() : -1 );
 		
+		//Animations which do not fit in the budget are decoded while they are shown instead
+		qint64 frame_bytes = frame.bytesPerLine() * qint64( frame.height() );
+		bool stream = isAnim && frame_amount > 2 && frame_amount * frame_bytes > stream_budget;
+		
 		int current_frame = 1;
 		do{
-			cache.add_frame( frame, image_reader.nextImageDelay() );
+			cache.add_frame( frame, delay );
 			if( frame_amount > 0 && current_frame >= frame_amount )
 				break;
+			if( stream && ( current_frame + 1 ) * frame_bytes > stream_budget ){
+				cache.set_source( std::move( source ), current_frame, stream_budget );
+				return ERROR_NONE;
+			}
 			current_frame++;
-			image_reader.jumpToNextImage();
 		}
-		while( image_reader.read( &frame ) );
+		while( source->read( frame, delay ) );
 		
 		cache.set_fully_loaded();
 		//TODO: What to do on fail?
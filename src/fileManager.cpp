@@ -23,12 +23,12 @@
 #include <QDir>
 #include <QStringList>
 #include <QCoreApplication>
-#include <QTime>
-#include <QDirIterator>
+#include <QFileInfo>
+#include <QSet>
 #include <QtAlgorithms>
 
-#include <QMutex>
-#include <QMutexLocker>
+#include <algorithm>
+#include <iterator>
 
 #include <qglobal.h>
 #ifdef Q_OS_WIN
@@ -37,9 +37,30 @@
 #endif
 
 
-fileManager::fileManager( const QSettings& settings ) : settings( settings ), have_ext( ImageReader().supportedExtensions() ){
+static QCollator collatorFromSettings( const QSettings& settings ){
+	QCollator collator;
+	collator.setNumericMode( settings.value( "loading/natural-number-order", false ).toBool() );
+	bool case_sensitivity = settings.value( "loading/case-sensitive", false ).toBool();
+	collator.setCaseSensitivity( case_sensitivity ? Qt::CaseSensitive : Qt::CaseInsensitive );
+	bool punctuation = settings.value( "loading/ignore-punctuation", collator.ignorePunctuation() ).toBool();
+	collator.setIgnorePunctuation( punctuation );
+	return collator;
+}
+
+
+fileManager::fileManager( const QSettings& settings )
+	:	settings( settings ), have_ext( ImageReader().supportedExtensions() ), loader( settings )
+	,	collator( collatorFromSettings( settings ), settings.value( "loading/log-collation", false ).toBool() ) {
 	connect( &loader, SIGNAL( image_fetched() ), this, SLOT( loading_handler() ) );
-	connect( &watcher, SIGNAL( directoryChanged( QString ) ), this, SLOT( dir_modified() ) );
+	
+	//Wait shortly after changes, to ensure files have been updated and to handle several changes at once
+	watcher.set_delay( settings.value( "loading/rescan-delay", 200 ).toInt() );
+	connect( &watcher, SIGNAL( rescan_needed() ), this, SLOT( dir_modified() ) );
+	connect( &watcher, &DirWatcher::changed, this, &fileManager::apply_changes );
+	connect( &lister, SIGNAL( found( QStringList ) ), this, SLOT( add_listed( QStringList ) ) );
+	connect( &lister, SIGNAL( finished() ), this, SLOT( listing_finished() ) );
+	connect( &rescanner, SIGNAL( found( QStringList ) ), this, SLOT( add_rescanned( QStringList ) ) );
+	connect( &rescanner, SIGNAL( finished() ), this, SLOT( rescan_finished() ) );
 	
 	bool hidden_default = false;
 	bool extension_default = false;
@@ -59,13 +80,6 @@ fileManager::fileManager( const QSettings& settings ) : settings( settings ), ha
 	recursive = settings.value( "loading/recursive", false ).toBool();
 	wrap = settings.value( "loading/wrap", true ).toBool();
 	buffer_max = settings.value( "loading/buffer-max", 3 ).toInt();
-	
-	//Set collation settings
-	collator.setNumericMode( settings.value( "loading/natural-number-order", false ).toBool() );
-	bool case_sensitivity = settings.value( "loading/case-sensitive", false ).toBool();
-	collator.setCaseSensitivity( case_sensitivity ? Qt::CaseSensitive : Qt::CaseInsensitive );
-	bool punctuation = settings.value( "loading/ignore-punctuation", collator.ignorePunctuation() ).toBool();
-	collator.setIgnorePunctuation( punctuation );
 }
 
 void fileManager::set_files( QFileInfo file ){
@@ -86,9 +100,10 @@ void fileManager::set_files( QFileInfo file ){
 		//Start loading image instantly
 		auto img = loader.load_image( file.absoluteFilePath() );
 		
+		//Show it right away, the rest of the files are added as they are listed
 		load_files( file.dir() );
-		
-		current_file = index_of( {	recursive ? file.filePath() : file.fileName(), collator });
+		files.push_back( { recursive ? file.absoluteFilePath() : file.fileName(), collator } );
+		current_file = 0;
 		
 		files[current_file].cache = std::move(img);
 		emit position_changed();
@@ -100,33 +115,57 @@ void fileManager::set_files( QFileInfo file ){
 	}
 }
 
-void fileManager::load_files( QDir current_dir ){
+QDir::Filters fileManager::filters() const{
 	//If hidden, include hidden files
 	QDir::Filters filters = QDir::Files;
 	if( show_hidden || force_hidden )
 		filters |= QDir::Hidden;
-	current_dir.setFilter( filters );
-	
+	return filters;
+}
+
+/* Starts over with the files in <current_dir>, which are added by add_listed() as they are found */
+void fileManager::load_files( QDir current_dir ){
 	//Begin caching
 	clear_cache();
+	listing = true;
 	
-	//This folder, or all sub-folders as well
-	auto flags = recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags;
-	QDirIterator it( current_dir, flags );
-	while( it.hasNext() ){
-		it.next();
-		auto file = recursive ? it.filePath() : it.fileName();
-		if( supports_extension( file ) )
-			files.push_back( {file, collator} );
+	dir = current_dir.absolutePath();
+	watcher.watch( dir );
+	lister.list( QDir( dir ), filters(), recursive, have_ext );
+}
+
+/* Merges a batch of listed files into the sorted list */
+void fileManager::add_listed( QStringList names ){
+	if( !has_file() )
+		return;
+	File current = files[current_file];
+	
+	//The watcher might have added some of them already, or removed them since
+	drop_removed( names );
+	auto keys = collator.keys( names );
+	std::vector<File> batch;
+	batch.reserve( names.size() );
+	for( int i=0; i<names.size(); i++ ){
+		File file( names[i], std::move( keys[i] ) );
+		if( position_of( file ) == -1 )
+			batch.push_back( std::move( file ) );
 	}
+	std::sort( batch.begin(), batch.end() );
 	
-	qSort( files.begin(), files.end() );
+	int middle = file_count();
+	std::move( batch.begin(), batch.end(), std::back_inserter( files ) );
+	std::inplace_merge( files.begin(), files.begin() + middle, files.end() );
 	
-	QString path = current_dir.absolutePath();
-	if( path != dir ){
-		dir = path;
-		watcher.addPath( dir );
-	}
+	current_file = position_of( current );
+	emit position_changed();
+	loading_handler();
+}
+
+void fileManager::listing_finished(){
+	listing = false;
+	if( !scanning() )
+		removed_names.clear();
+	emit position_changed(); //The position is known now
 }
 
 void fileManager::load_image( int pos ){
@@ -152,14 +191,14 @@ void fileManager::load_image( int pos ){
 int fileManager::move( int offset ) const{
 	int wanted = current_file + offset;
 	
-	if( !wrap || files.size() <= 0 )
+	if( !wrap || file_count() <= 0 )
 		return wanted; //empty list would cause infinite loop
 	
 	//Keep warping until we reached a valid index
 	while( wanted < 0 )
-		wanted += files.size();
-	while( wanted >= files.size() )
-		wanted -= files.size();
+		wanted += file_count();
+	while( wanted >= file_count() )
+		wanted -= file_count();
 	
 	return wanted;
 }
@@ -174,6 +213,30 @@ void fileManager::goto_file( int index ){
 }
 
 
+void fileManager::set_monitor( int monitor ){
+	loader.set_monitor( monitor );
+	prepare_images();
+}
+
+void fileManager::set_visible( bool value ){
+	visible = value;
+	if( visible )
+		loading_handler(); //Continue prefetching
+}
+
+/* Makes sure the cached images are prepared for the current monitor */
+void fileManager::prepare_images(){
+	if( current_file == -1 )
+		return;
+	
+	//The current file is prepared last, as it will be placed in front of the others
+	int loading_length = settings.value( "loading/length", 2 ).toInt();
+	for( int i=loading_length; i>=0; i-- )
+		for( int pos : { move( i ), move( -i ) } )
+			if( has_file( pos ) )
+				loader.prepare_image( files[pos].cache );
+}
+
 void fileManager::unload_image( int index ){
 	if( !has_file(index) || !files[index].cache )
 		return;
@@ -192,7 +255,9 @@ void fileManager::loading_handler(){
 		return;
 	
 	int loading_length = settings.value( "loading/length", 2 ).toInt();
-	for( int i=0; i<=loading_length; i++ ){
+	int prefetch_length = visible ? loading_length
+		:	std::min( loading_length, settings.value( "loading/hidden-length", loading_length ).toInt() );
+	for( int i=0; i<=prefetch_length; i++ ){
 		int next = move( i );
 		if( has_file(next) && !files[next].cache ){
 			load_image( next );
@@ -210,7 +275,7 @@ void fileManager::loading_handler(){
 	int last = move( loading_length+1 );
 	int first = move( -loading_length-1 );
 	if( last > first ){
-		for( int i=last; i<files.size(); i++ )
+		for( int i=last; i<file_count(); i++ )
 			unload_image( i );
 		for( int i=first; i>=0; i-- )
 			unload_image( i );
@@ -218,12 +283,19 @@ void fileManager::loading_handler(){
 	else
 		for( int i=last; i<=first; i++ )
 			unload_image( i );
+	
+	//Images restored from the buffer might have been prepared for another monitor
+	prepare_images();
 }
 
 
 void fileManager::clear_cache(){
-	if( watcher.directories().size() > 0 )
-		watcher.removePaths( watcher.directories() );
+	lister.cancel();
+	listing = false;
+	rescanner.cancel();
+	rescanned.clear();
+	removed_names.clear();
+	watcher.clear();
 	dir = "";
 	if( current_file != -1 ){
 		current_file = -1;
@@ -237,56 +309,150 @@ void fileManager::clear_cache(){
 
 /** @return The index of <file> or -1 if not found */
 int fileManager::index_of( File file ) const{
-	auto it = qBinaryFind( files.begin(), files.end(), file );
-	return it != files.end() ? it - files.begin() : -1;
+	auto it = std::lower_bound( files.begin(), files.end(), file );
+	return it != files.end() && !( file < *it ) ? it - files.begin() : -1;
 }
 
 /** @return A valid index closest to <file> */
 int fileManager::find_file( File file ){
-	auto it = qLowerBound( files.begin(), files.end(), file );
-	return it != files.end() ? it - files.begin() : files.size()-1;
+	auto it = std::lower_bound( files.begin(), files.end(), file );
+	return it != files.end() ? it - files.begin() : file_count()-1;
 }
 
-static QMutex mutex; //TODO: This should be part of fileManager
+/* Lists the directory again in the background, restarting if it already was */
 void fileManager::dir_modified(){
-	//Make absolutely sure this is not called again before it finish loading
-	disconnect( &watcher, SIGNAL( directoryChanged( QString ) ), this, SLOT( dir_modified() ) );
-	QMutexLocker locker(&mutex);
-	
-	//Wait shortly to ensure files have been updated
-	//Solution by kshark27: http://stackoverflow.com/a/11487434/2248153
-	QTime wait = QTime::currentTime().addMSecs( 200 );
-	while( QTime::currentTime() < wait )
-		QCoreApplication::processEvents( QEventLoop::AllEvents, 100 );
-	
-	connect( &watcher, SIGNAL( directoryChanged( QString ) ), this, SLOT( dir_modified() ) );
+	if( !has_file() )
+		return;
 	
-	//processEvents can modify this object, so check this afterwards
+	rescanned.clear();
+	rescanner.list( QDir( dir ), filters(), recursive, have_ext );
+}
+
+/* Updates the list once the rescan is complete, only the files added are sorted */
+void fileManager::rescan_finished(){
+	auto names = rescanned;
+	rescanned.clear();
+	drop_removed( names );
+	if( !scanning() )
+		removed_names.clear();
 	if( !has_file() )
 		return;
 	
-	//Save imageCache's which might still be valid
-	QList<File> old;
+	//Keep the name of the old file, for restoring position
+	File old_file = files[current_file];
+	
+	auto listed = names.toSet();
+	QSet<QString> known;
+	known.reserve( file_count() );
 	for( auto& file : files )
-		if( file.cache )
-			old << std::move( file ); //NOTE: Expects load_files to clear files
+		known << file.name;
+	
+	//Remove the files which are gone, the rest stays sorted
+	auto removed = [&]( const File& file ){ return !listed.contains( file.name ); };
+	files.erase( std::remove_if( files.begin(), files.end(), removed ), files.end() );
+	for( auto it = buffer.begin(); it != buffer.end(); )
+		it = removed( *it ) ? buffer.erase( it ) : std::next( it );
+	
+	//Insert the new files where they belong
+	QStringList added;
+	for( auto& name : names )
+		if( !known.contains( name ) )
+			added << name;
+	auto keys = collator.keys( added );
+	if( added.size() > 64 ){
+		//Sorting is faster than inserting them one by one
+		int middle = file_count();
+		for( int i=0; i<added.size(); i++ )
+			files.emplace_back( added[i], std::move( keys[i] ) );
+		std::sort( files.begin() + middle, files.end() );
+		std::inplace_merge( files.begin(), files.begin() + middle, files.end() );
+	}
+	else
+		for( int i=0; i<added.size(); i++ ){
+			File file( added[i], std::move( keys[i] ) );
+			files.insert( std::lower_bound( files.begin(), files.end(), file ), std::move( file ) );
+		}
+	
+	restore_position( old_file );
+}
+
+/** @return The index of the file named as <file>, or -1. Unlike index_of() it does not match other names sorted the same */
+int fileManager::position_of( const File& file ) const{
+	for( auto it = std::lower_bound( files.begin(), files.end(), file ); it != files.end() && it->key.compare( file.key ) == 0; ++it )
+		if( it->name == file.name )
+			return it - files.begin();
+	return -1;
+}
+
+bool fileManager::listable( QString name ) const{
+	return supports_extension( name ) && ( show_hidden || force_hidden || !QFileInfo( prefix() + name ).isHidden() );
+}
+
+void fileManager::drop_removed( QStringList& names ) const{
+	if( removed_names.isEmpty() )
+		return;
+	auto removed = [&]( const QString& name ){ return removed_names.contains( name ); };
+	names.erase( std::remove_if( names.begin(), names.end(), removed ), names.end() );
+}
+
+void fileManager::forget_buffered( QString name ){
+	for( auto it = buffer.begin(); it != buffer.end(); )
+		it = it->name == name ? buffer.erase( it ) : std::next( it );
+}
+
+/* Applies the changes reported by the watcher, each is a binary search and an insert or remove */
+void fileManager::apply_changes( std::vector<DirWatcher::Change> changes ){
+	if( !has_file() )
+		return;
 	
 	//Keep the name of the old file, for restoring position
 	File old_file = files[current_file];
 	
-	//Prepare the QLists
-	current_file = -1; //TODO: we need this to avoid clear_cache() to notify the viewer. FIX
-	load_files( dir );
-	
-	//Restore old elements
-	for( auto& elem : old ){
-		int new_index = index_of( elem );
-		if( new_index != -1 )
-			files[new_index] = std::move( elem );
+	auto name = [&]( QString relative ){ return recursive ? dir + "/" + relative : relative; };
+	for( auto& change : changes ){
+		File file( name( change.type == DirWatcher::Change::RENAMED ? change.to : change.name ), collator );
+		
+		if( change.type == DirWatcher::Change::RENAMED ){
+			//It is still the same file, so keep the image
+			File from( name( change.name ), collator );
+			int index = position_of( from );
+			if( index != -1 ){
+				file.cache = std::move( files[index].cache );
+				files.erase( files.begin() + index );
+			}
+			forget_buffered( from.name );
+			if( scanning() )
+				removed_names << from.name;
+			if( old_file.name == from.name )
+				old_file = file;
+		}
+		
+		int index = position_of( file );
+		if( change.type == DirWatcher::Change::REMOVED ){
+			if( index != -1 )
+				files.erase( files.begin() + index );
+			forget_buffered( file.name );
+			if( scanning() )
+				removed_names << file.name;
+			continue;
+		}
+		
+		removed_names.remove( file.name );
+		if( index != -1 ){
+			//Written again, so the image is outdated
+			files[index].cache = std::move( file.cache );
+			forget_buffered( file.name );
+		}
+		else if( listable( file.name ) )
+			files.insert( std::lower_bound( files.begin(), files.end(), file ), file );
 	}
-	old.clear();
 	
-	if( files.size() == 0 ){
+	restore_position( old_file );
+}
+
+/* Finds <old_file> again after the list changed, or the file closest to it if it is gone */
+void fileManager::restore_position( File old_file ){
+	if( files.empty() ){
 		if( settings.value( "loading/quit-on-empty", false ).toBool() )
 			QCoreApplication::quit();
 		current_file = -1;
@@ -325,11 +491,15 @@ QString fileManager::file_name() const{
 	if( extension_hidden && dot != -1 )
 		name = name.left( dot );
 	
+	//The position is not known before all files have been listed
+	if( listing )
+		return QString( "%1 - [...]" ).arg( name );
+	
 	//TODO: once we have a meta-data system, check if it contains a title
 	return QString( "%1 - [%2/%3]" )
 		.arg( name )
 		.arg( QString::number( current_file+1 ) )
-		.arg( QString::number( files.size() ) )
+		.arg( QString::number( file_count() ) )
 		;
 }
 
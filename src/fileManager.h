@@ -22,15 +22,18 @@
 #include <QString>
 #include <QStringList>
 #include <QFileInfoList>
-#include <QFileSystemWatcher>
 #include <QSettings>
 #include <QLinkedList>
-#include <QCollator>
+#include <QSet>
 
 #include <memory>
+#include <vector>
 
 #include "imageLoader.h"
+#include "FileSystem/DirLister.hpp"
+#include "FileSystem/DirWatcher.hpp"
 #include "FileSystem/ExtensionChecker.hpp"
+#include "FileSystem/NameCollator.hpp"
 
 
 class imageCache;
@@ -40,7 +43,14 @@ class fileManager : public QObject{
 	
 	private:
 		const QSettings& settings;
-		QFileSystemWatcher watcher;
+		DirWatcher watcher;
+		DirLister lister;
+		bool listing{ false }; //Files are still being added by 'lister'
+		DirLister rescanner; //Lists the directory again if the watcher can't tell what changed
+		QStringList rescanned; //Found by 'rescanner' so far
+		QSet<QString> removed_names; //Removed while listing, as a batch might have found them before that
+		bool scanning() const{ return listing || rescanner.is_listing(); }
+		void drop_removed( QStringList& names ) const;
 		ExtensionChecker have_ext;
 		imageLoader loader;
 		
@@ -49,21 +59,23 @@ class fileManager : public QObject{
 		bool extension_hidden;
 		bool recursive;
 		bool wrap;
+		bool visible{ true }; //If the window can be seen, prefetching might be reduced if not
 		
-		QCollator collator;
+		NameCollator collator; //Before 'files' and 'buffer', as their keys refer to it
 		struct File{
 			QString name; //relative file path
-			QCollatorSortKey key;
+			NameCollator::Key key;
 			std::shared_ptr<imageCache> cache;
 			
-			File( QString name, const QCollator& c ) : name(name), key(c.sortKey( name )) { }
+			File( QString name, NameCollator::Key key ) : name(name), key(key) { }
+			File( QString name, const NameCollator& c ) : name(name), key(c.key( name )) { }
 			//TODO: on win8.1 in release mode, if name are equals, key::compare returns a random value
 			bool operator<( const File& other ) const{ return name != other.name && key < other.key; }
 			bool operator==( const File& other ) const{ return key.compare(other.key) == 0; }
 			bool operator!=( const File& other ) const{ return !(*this == other); }
 		};
 		QString dir;       //Current directory (without last '/')
-		QList<File> files;
+		std::vector<File> files; //Contiguous, as huge directories are sorted and searched often
 		int current_file;  //Index to currently used file
 		
 		unsigned buffer_max;
@@ -76,11 +88,17 @@ class fileManager : public QObject{
 		int index_of( File file ) const;
 		
 		void load_image( int pos );
+		void prepare_images();
 		
+		QDir::Filters filters() const;
 		void load_files( QDir dir );
 		void clear_cache();
 		
 		int find_file( File file );
+		int position_of( const File& file ) const;
+		bool listable( QString name ) const;
+		void forget_buffered( QString name );
+		void restore_position( File old_file );
 		
 	public:
 		explicit fileManager( const QSettings& settings );
@@ -91,7 +109,8 @@ class fileManager : public QObject{
 		void set_files( QString file ){ set_files( QFileInfo( file ) ); }
 		void set_files( QFileInfo file );
 		
-		bool has_file( int index ) const{ return index >= 0 && index < files.size(); }
+		int file_count() const{ return files.size(); }
+		bool has_file( int index ) const{ return index >= 0 && index < file_count(); }
 		bool has_file() const{ return has_file( current_file ); }
 		int move( int offset ) const;
 		
@@ -111,9 +130,18 @@ class fileManager : public QObject{
 		QString file_path() const{ return has_file() ? file( current_file ) : ""; }
 		
 		
+	public slots:
+		void set_monitor( int monitor );
+		void set_visible( bool value );
+	
 	private slots:
 		void loading_handler();
 		void dir_modified();
+		void add_rescanned( QStringList names ){ rescanned << names; }
+		void rescan_finished();
+		void apply_changes( std::vector<DirWatcher::Change> changes );
+		void add_listed( QStringList names );
+		void listing_finished();
 		
 	signals:
 		void file_changed();
@@ -122,6 +122,8 @@ imageContainer::imageContainer( QWidget* parent ) : QWidget( parent )
 	connect( ui->btn_prev,     SIGNAL( pressed() ), this, SLOT( prev_file() ) );
 	connect( files.get(), SIGNAL( file_changed() ),     this, SLOT( update_file() ) );
 	connect( files.get(), SIGNAL( position_changed() ), this, SLOT( updatePosition() ) );
+	connect( viewer, SIGNAL( monitor_changed(int) ), files.get(), SLOT( set_monitor(int) ) );
+	connect( viewer, SIGNAL( visibility_changed(bool) ), files.get(), SLOT( set_visible(bool) ) );
 }
 
 //We just need this here to avoid including fileManager and windowManager in the header
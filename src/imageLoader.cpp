@@ -18,49 +18,155 @@
 #include "imageLoader.h"
 
 #include "viewer/imageCache.h"
-#include <QMutexLocker>
-#include <QFileInfo>
-
-#include "ImageReader/ImageReader.hpp"
-
-void imageLoader::run(){
-	mutex.lock();
-	while( image ){
-		//Load data
-		QString filepath = file;
-		auto loading = std::move( image );
-		
-		mutex.unlock();
-		emit image_fetched();
-		
-		ImageReader reader; //TODO: initialize in constructor?
-		reader.read( *loading, filepath );
-		emit image_loaded( loading.get() );
-		
-		mutex.lock();	//Make sure to lock it again, as wee need it at the while loop check
+#include "viewer/colorManager.h"
+
+#include <QPainter>
+#include <QtConcurrent>
+#include <QThread>
+#include <QUrl>
+
+#include <algorithm>
+
+static int stageThreads( const QSettings& settings, QString stage, int fallback )
+	{ return settings.value( "pipeline/" + stage + "-threads", fallback ).toInt(); }
+
+static int stageQueue( const QSettings& settings, QString stage, int fallback )
+	{ return settings.value( "pipeline/" + stage + "-queue", fallback ).toInt(); }
+
+imageLoader::imageLoader( const QSettings& settings )
+	:	log_stats( settings.value( "pipeline/log-stats", false ).toBool() )
+	,	lut_size( settings.value( "color/lut-size", 0 ).toUInt() )
+	//Color management already runs multi-threaded internally, so one thread is enough
+	,	prepare( "prepare", stageThreads( settings, "prepare", 1 ), stageQueue( settings, "prepare", 16 ) )
+	,	color(   "color",   stageThreads( settings, "color",   1 ), stageQueue( settings, "color",   16 ) )
+	,	decode(  "decode",  stageThreads( settings, "decode",  std::max( 1, QThread::idealThreadCount()/2 ) ), stageQueue( settings, "decode", 2 ) )
+	,	io(      "io",      stageThreads( settings, "io",      1 ), stageQueue( settings, "io",      2 ) )
+	{ }
+
+void imageLoader::read_file( std::shared_ptr<imageCache> image, QString filepath ){
+	emit image_fetched();
+	
+	QByteArray data;
+	if( !ImageReader::readFile( filepath, data ) ){
+		image->url = QUrl::fromLocalFile( filepath );
+		image->set_status( imageCache::EMPTY );
+		emit image_loaded( image.get() );
+		return;
 	}
-	mutex.unlock(); //Make sure to lock it when the while loop exits
+	
+	//Waits if the decoders are busy, the file after this one can then stay in the io queue
+	decode.push( [=](){ decode_file( image, filepath, data ); } );
 }
 
-/* Attempts to start loading an image. Returns true on success, false on failure. */
-std::shared_ptr<imageCache> imageLoader::load_image( QString filepath ){
-	mutex.lock();
-	if( image ){
-		//An image is already in the queue, can't add this one
-		mutex.unlock();
-		return {};
+void imageLoader::decode_file( std::shared_ptr<imageCache> image, QString filepath, QByteArray data ){
+	//Start color managing frames as soon as they are decoded
+	std::weak_ptr<imageCache> weak = image;
+	auto connection = connect( image.get(), &imageCache::frame_loaded, this, [this,weak]( unsigned index ){
+			if( auto image = weak.lock() )
+				color.push( [=](){ convert_frame( image, index ); } );
+		}, Qt::DirectConnection );
+	
+	reader.read( *image, filepath, data );
+	if( image->is_streamed() ){
+		//Frames keep being decoded while it is shown, which is not worth holding up the decode stage for
+		connect( image.get(), &imageCache::frames_wanted, this, [weak](){
+				if( auto image = weak.lock() )
+					QtConcurrent::run( [=](){ image->load_ahead(); } );
+			} );
 	}
+	else
+		disconnect( connection );
+	emit image_loaded( image.get() );
 	
-	image = std::make_shared<imageCache>();
-	file = filepath;
+	if( log_stats ){
+		for( auto& s : stats() )
+			qDebug( "%-8s queued %d/%d (max %d), running %d/%d, done %lu, wait %.1f ms, run %.1f ms"
+				,	qPrintable( s.name ), s.queued, s.capacity, s.max_queued
+				,	s.running, s.threads, s.processed, s.wait_ms, s.run_ms
+				);
+		qDebug( "color managed images: %lu transformed, %lu skipped as the profiles matched"
+			,	image->get_manager()->transformCount(), image->get_manager()->identityCount() );
+	}
+}
+
+void imageLoader::convert_frame( std::shared_ptr<imageCache> image, unsigned index ){
+	auto frame = image->frame( index );
+	if( frame.isNull() )
+		return;
 	
-	mutex.unlock();
+	//Use the newest monitor, the frame is discarded if it changes while being prepared
+	int monitor = image->get_display_monitor();
 	
-	if( !isRunning() )
-		start();
+	//Animations often only change a small part, only that needs to be color managed
+	auto changed = image->frame_changed( index );
+	if( changed != frame.rect() ){
+		auto changes = frame.copy( changed );
+		image->get_manager()->doTransform( changes, image->get_profile(), monitor, lut_size );
+		prepare.push( [=](){ prepare_changes( image, index, monitor, changes, changed ); } );
+		return;
+	}
 	
-	return image;
+	image->get_manager()->doTransform( frame, image->get_profile(), monitor, lut_size );
+	prepare.push( [=](){ prepare_frame( image, index, monitor, frame ); } );
 }
 
+void imageLoader::prepare_changes( std::shared_ptr<imageCache> image, unsigned index, int monitor, QImage changes, QRect area ){
+	//Frames are prepared in order, unless there are several threads or the monitor changed
+	auto previous = image->display_frame( index-1, monitor );
+	if( previous.isNull() ){
+		auto frame = image->frame( index );
+		image->get_manager()->doTransform( frame, image->get_profile(), monitor, lut_size );
+		prepare_frame( image, index, monitor, frame );
+		return;
+	}
+	
+	//The rest is the same as the previous frame
+	auto frame = previous.copy();
+	QPainter painter( &frame );
+	painter.setCompositionMode( QPainter::CompositionMode_Source );
+	painter.drawImage( area.topLeft(), changes );
+	painter.end();
+	
+	prepare_frame( image, index, monitor, frame );
+}
+
+void imageLoader::prepare_frame( std::shared_ptr<imageCache> image, unsigned index, int monitor, QImage frame ){
+	//Use a format QPainter can draw directly, the decoders already use these except for indexed images
+	if( frame.format() != QImage::Format_RGB32 && frame.format() != QImage::Format_ARGB32_Premultiplied )
+		frame = frame.convertToFormat( frame.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32 );
+	
+	image->set_display_frame( index, monitor, frame );
+	
+	//Large frames can be shown already, while the levels for zooming out are made
+	MipChain mipmaps( frame );
+	if( !mipmaps.empty() )
+		image->set_display_mipmaps( index, monitor, frame, std::move( mipmaps ) );
+}
 
+/* Attempts to start loading an image. Returns an empty pointer if the queue is full. */
+std::shared_ptr<imageCache> imageLoader::load_image( QString filepath ){
+	auto image = std::make_shared<imageCache>();
+	image->set_display_monitor( monitor );
+	if( !io.try_push( [=](){ read_file( image, filepath ); } ) )
+		return {};
+	return image;
+}
 
+/* Prepares the frames which have been loaded so far for the current monitor, if they are not already */
+void imageLoader::prepare_image( std::shared_ptr<imageCache> image ){
+	int target = monitor;
+	if( !image || !image->set_display_monitor( target ) )
+		return;
+	
+	//Frames which are still being decoded will use the new monitor automatically
+	int amount = image->frame_count(); //Frames might be loaded out of order
+	color.push_urgent( [=](){
+			for( int i=0; i<amount; i++ )
+				if( image->display_frame( i, target ).isNull() )
+					convert_frame( image, i );
+		} );
+}
+
+std::vector<PipelineStage::Stats> imageLoader::stats() const{
+	return { io.stats(), decode.stats(), color.stats(), prepare.stats() };
+}
@@ -19,42 +19,83 @@
 #define IMAGELOADER_H
 
 /*
-	This class loads a imageCache in a separate thread.
-	It can only load one at a time but it can store a single imageCache
-	until it is ready to start loading it. The signal image_fetched()
-	is emitted when it is possible to store a new one.
-	The signal image_loaded() is emitted when it is done loading an
-	imageCache.
+	This class loads imageCaches in a pipeline of separate stages:
+	- io:      Reads the file into memory
+	- decode:  Decodes the file data into frames
+	- color:   Color manages each frame for the target monitor
+	- prepare: Converts each frame into a format which can be drawn
+	           without further conversions, and makes a MipChain for
+	           large frames
+	Each stage has its own threads and a bounded queue, so the file for
+	the next image can be read while the current one is being decoded.
+	Frames are passed on to the color stage as soon as they are decoded.
+	They are color managed for the monitor set with set_monitor(), if
+	the monitor changes prepare_image() prepares the frames of an image
+	again. Frames for the previous monitor are kept, so moving back and
+	forth between two monitors only prepares them once. Animation frames
+	which only change part of the previous frame are only color managed
+	where they changed, and then put on top of the previous prepared frame.
+	Animations too large to keep in memory are decoded while they are shown,
+	imageCache::frames_wanted() then decodes more in the global thread pool.
 	
-	Use the function bool load_image( imageCache*, QString ) to attempt
-	to add an imageCache for loading, returns true on success, false on
-	failure.
+	Use the function std::shared_ptr<imageCache> load_image( QString ) to
+	attempt to add an image for loading. It returns an empty pointer if
+	the queue is full. The signal image_fetched() is emitted when an image
+	has been taken from the queue, so a new one can be added.
+	The signal image_loaded() is emitted when an image has been decoded,
+	prepared frames are announced by imageCache::frame_prepared().
 	
-	Use delete_image( imageCache* ) to delete imageCache* which have been
-	loaded with the same object safely.
+	The amount of threads and the queue sizes are read from the settings
+	"pipeline/<stage>-threads" and "pipeline/<stage>-queue", setting
+	"pipeline/log-stats" prints the statistics for each stage after an
+	image has been decoded. Setting "color/lut-size" to a grid size, for
+	example 33, color manages with a ColorLut instead of lcms.
 */
 
-#include <QThread>
-#include <QMutex>
+#include <QObject>
+#include <QSettings>
+#include <QByteArray>
+#include <QImage>
+#include <QRect>
+
+#include <atomic>
 #include <memory>
+#include <vector>
+
+#include "viewer/PipelineStage.hpp"
+#include "ImageReader/ImageReader.hpp"
 
 class imageCache;
 
-class imageLoader: public QThread{
+class imageLoader: public QObject{
 	Q_OBJECT
 	
 	private:
-		QMutex mutex;
-		std::shared_ptr<imageCache> image;
-		QString file;	//Path to file which shall be loaded
-	
-	protected:
-		void run();
+		ImageReader reader;
+		std::atomic<int> monitor{ 0 };
+		bool log_stats;
+		unsigned lut_size;
+		
+		//Declared in reverse order, so later stages outlive the ones feeding them
+		PipelineStage prepare;
+		PipelineStage color;
+		PipelineStage decode;
+		PipelineStage io;
+		
+		void read_file( std::shared_ptr<imageCache> image, QString filepath );
+		void decode_file( std::shared_ptr<imageCache> image, QString filepath, QByteArray data );
+		void convert_frame( std::shared_ptr<imageCache> image, unsigned index );
+		void prepare_frame( std::shared_ptr<imageCache> image, unsigned index, int monitor, QImage frame );
+		void prepare_changes( std::shared_ptr<imageCache> image, unsigned index, int monitor, QImage changes, QRect area );
 	
 	public:
-		explicit imageLoader() { };
+		explicit imageLoader( const QSettings& settings );
 		std::shared_ptr<imageCache> load_image( QString filepath );
 		
+		void set_monitor( int monitor ){ this->monitor = monitor; }
+		void prepare_image( std::shared_ptr<imageCache> image );
+		std::vector<PipelineStage::Stats> stats() const;
+		
 	signals:
 		void image_fetched();
 		void image_loaded( imageCache *img );
@@ -0,0 +1,254 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ColorLut.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+	#define COLOR_LUT_AVX2
+	#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+	#define COLOR_LUT_SSE2
+	#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+//Bound to references by min() and max(), so they need a definition
+const unsigned ColorLut::default_size;
+const unsigned ColorLut::min_size;
+const unsigned ColorLut::max_size;
+
+
+ColorLut::ColorLut( const Sampler& sample, unsigned grid_size )
+	:	size( min( max( grid_size, min_size ), max_size ) ) {
+	//Sample one red/green line at a time, so the sampler gets a decent amount of work
+	vector<float> in( size * 3 ), out( size * 3 );
+	nodes.resize( size * size * size * 4 );
+	auto node = nodes.data();
+	for( unsigned ir=0; ir<size; ir++ )
+		for( unsigned ig=0; ig<size; ig++ ){
+			for( unsigned ib=0; ib<size; ib++ ){
+				in[ib*3+0] = ir / float(size-1);
+				in[ib*3+1] = ig / float(size-1);
+				in[ib*3+2] = ib / float(size-1);
+			}
+			sample( in.data(), out.data(), size );
+			
+			for( unsigned ib=0; ib<size; ib++, node+=4 ){
+				for( int c=0; c<3; c++ )
+					node[2-c] = min( max( out[ib*3+c], 0.0f ), 1.0f ) * 255;
+				node[3] = 0;
+			}
+		}
+}
+
+
+/** Finds the tetrahedron containing the fractional position and the weights of its corners */
+struct Tetrahedron{
+	unsigned first, second; //Node offsets of the two corners between (0,0,0) and (1,1,1)
+	float w0, w1, w2, w3;   //Weights for (0,0,0), first, second and (1,1,1)
+	
+	Tetrahedron( float fr, float fg, float fb, unsigned sr, unsigned sg, unsigned sb ){
+		float f1, f2, f3;
+		if( fr >= fg ){
+			if( fg >= fb )      { f1=fr; f2=fg; f3=fb; first=sr; second=sr+sg; }
+			else if( fr >= fb ) { f1=fr; f2=fb; f3=fg; first=sr; second=sr+sb; }
+			else                { f1=fb; f2=fr; f3=fg; first=sb; second=sb+sr; }
+		}
+		else{
+			if( fr >= fb )      { f1=fg; f2=fr; f3=fb; first=sg; second=sg+sr; }
+			else if( fg >= fb ) { f1=fg; f2=fb; f3=fr; first=sg; second=sg+sb; }
+			else                { f1=fb; f2=fg; f3=fr; first=sb; second=sb+sg; }
+		}
+		w0 = 1 - f1;
+		w1 = f1 - f2;
+		w2 = f2 - f3;
+		w3 = f3;
+	}
+};
+
+static void executePixels( const float* nodes, unsigned size, const uint32_t* in, uint32_t* out, unsigned pixels ){
+	const float scale = ( size - 1 ) / 255.0f;
+	const unsigned sr = size*size, sg = size, sb = 1;
+	const int last = size - 2;
+	
+	for( unsigned i=0; i<pixels; i++ ){
+		auto pixel = in[i];
+		float fb = ( pixel       & 0xFF) * scale;
+		float fg = ((pixel >> 8) & 0xFF) * scale;
+		float fr = ((pixel >>16) & 0xFF) * scale;
+		int ib = min( int(fb), last );
+		int ig = min( int(fg), last );
+		int ir = min( int(fr), last );
+		
+		Tetrahedron t( fr - ir, fg - ig, fb - ib, sr, sg, sb );
+		auto v0 = nodes + ( ir*sr + ig*sg + ib*sb ) * 4;
+		auto v1 = v0 + t.first  * 4;
+		auto v2 = v0 + t.second * 4;
+		auto v3 = v0 + ( sr + sg + sb ) * 4;
+
+#ifdef COLOR_LUT_SSE2
+		auto color = _mm_add_ps(
+				_mm_add_ps( _mm_mul_ps( _mm_loadu_ps( v0 ), _mm_set1_ps( t.w0 ) ), _mm_mul_ps( _mm_loadu_ps( v1 ), _mm_set1_ps( t.w1 ) ) )
+			,	_mm_add_ps( _mm_mul_ps( _mm_loadu_ps( v2 ), _mm_set1_ps( t.w2 ) ), _mm_mul_ps( _mm_loadu_ps( v3 ), _mm_set1_ps( t.w3 ) ) )
+			);
+		auto packed = _mm_cvtps_epi32( color );
+		packed = _mm_packs_epi32( packed, packed );
+		packed = _mm_packus_epi16( packed, packed );
+		uint32_t bgr = _mm_cvtsi128_si32( packed );
+#else
+		uint32_t bgr = 0;
+		for( int c=0; c<3; c++ ){
+			float value = v0[c]*t.w0 + v1[c]*t.w1 + v2[c]*t.w2 + v3[c]*t.w3;
+			bgr |= uint32_t( min( max( int(value + 0.5f), 0 ), 255 ) ) << (c*8);
+		}
+#endif
+		out[i] = ( bgr & 0x00FFFFFF ) | ( pixel & 0xFF000000 );
+	}
+}
+
+#ifdef COLOR_LUT_AVX2
+static bool hasAvx2(){
+	static const bool supported = __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" );
+	return supported;
+}
+
+/** Same as executePixels() for 8 pixels at a time, returns the amount of pixels done */
+__attribute__((target("avx2,fma")))
+static unsigned executeAvx2( const float* nodes, unsigned size, const uint32_t* in, uint32_t* out, unsigned pixels ){
+	const auto scale = _mm256_set1_ps( ( size - 1 ) / 255.0f );
+	const auto last  = _mm256_set1_epi32( size - 2 );
+	const auto byte  = _mm256_set1_epi32( 0xFF );
+	const auto alpha = _mm256_set1_epi32( 0xFF000000 );
+	const auto one   = _mm256_set1_ps( 1.0f );
+	const auto sr = _mm256_set1_epi32( size*size*4 );
+	const auto sg = _mm256_set1_epi32( size*4 );
+	const auto sb = _mm256_set1_epi32( 4 );
+	const auto sum = _mm256_set1_epi32( (size*size + size + 1) * 4 );
+	
+	unsigned i = 0;
+	for( ; i+8<=pixels; i+=8 ){
+		auto pixel = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( in + i ) );
+		auto fb = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( pixel, byte ) ), scale );
+		auto fg = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( pixel,  8 ), byte ) ), scale );
+		auto fr = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( pixel, 16 ), byte ) ), scale );
+		auto ib = _mm256_min_epi32( _mm256_cvttps_epi32( fb ), last );
+		auto ig = _mm256_min_epi32( _mm256_cvttps_epi32( fg ), last );
+		auto ir = _mm256_min_epi32( _mm256_cvttps_epi32( fr ), last );
+		fb = _mm256_sub_ps( fb, _mm256_cvtepi32_ps( ib ) );
+		fg = _mm256_sub_ps( fg, _mm256_cvtepi32_ps( ig ) );
+		fr = _mm256_sub_ps( fr, _mm256_cvtepi32_ps( ir ) );
+		
+		//Branchless version of Tetrahedron, the first corner steps along the largest
+		//fraction, the second along all except the smallest
+		auto r_max = _mm256_castps_si256( _mm256_and_ps( _mm256_cmp_ps( fr, fg, _CMP_GE_OQ ), _mm256_cmp_ps( fr, fb, _CMP_GE_OQ ) ) );
+		auto g_max = _mm256_andnot_si256( r_max, _mm256_castps_si256( _mm256_cmp_ps( fg, fb, _CMP_GE_OQ ) ) );
+		auto b_min = _mm256_castps_si256( _mm256_and_ps( _mm256_cmp_ps( fb, fg, _CMP_LE_OQ ), _mm256_cmp_ps( fb, fr, _CMP_LE_OQ ) ) );
+		auto g_min = _mm256_andnot_si256( b_min, _mm256_castps_si256( _mm256_cmp_ps( fg, fr, _CMP_LE_OQ ) ) );
+		auto first = _mm256_blendv_epi8( _mm256_blendv_epi8( sb, sg, g_max ), sr, r_max );
+		auto second = _mm256_sub_epi32( sum, _mm256_blendv_epi8( _mm256_blendv_epi8( sr, sg, g_min ), sb, b_min ) );
+		
+		auto f1 = _mm256_max_ps( fr, _mm256_max_ps( fg, fb ) );
+		auto f3 = _mm256_min_ps( fr, _mm256_min_ps( fg, fb ) );
+		auto f2 = _mm256_sub_ps( _mm256_add_ps( fr, _mm256_add_ps( fg, fb ) ), _mm256_add_ps( f1, f3 ) );
+		auto w0 = _mm256_sub_ps( one, f1 );
+		auto w1 = _mm256_sub_ps( f1, f2 );
+		auto w2 = _mm256_sub_ps( f2, f3 );
+		auto w3 = f3;
+		
+		auto base = _mm256_add_epi32( _mm256_add_epi32( _mm256_mullo_epi32( ir, sr ), _mm256_mullo_epi32( ig, sg ) ), _mm256_slli_epi32( ib, 2 ) );
+		auto v1 = _mm256_add_epi32( base, first );
+		auto v2 = _mm256_add_epi32( base, second );
+		auto v3 = _mm256_add_epi32( base, sum );
+		
+		auto result = _mm256_and_si256( pixel, alpha );
+		for( int c=0; c<3; c++ ){
+			auto channel = nodes + c;
+			auto value = _mm256_mul_ps( _mm256_i32gather_ps( channel, base, 4 ), w0 );
+			value = _mm256_fmadd_ps( _mm256_i32gather_ps( channel, v1, 4 ), w1, value );
+			value = _mm256_fmadd_ps( _mm256_i32gather_ps( channel, v2, 4 ), w2, value );
+			value = _mm256_fmadd_ps( _mm256_i32gather_ps( channel, v3, 4 ), w3, value );
+			auto converted = _mm256_min_epi32( _mm256_max_epi32( _mm256_cvtps_epi32( value ), _mm256_setzero_si256() ), byte );
+			result = _mm256_or_si256( result, _mm256_slli_epi32( converted, c*8 ) );
+		}
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>( out + i ), result );
+	}
+	return i;
+}
+#endif
+
+void ColorLut::execute( const void* input_buffer, void* output_buffer, unsigned pixels ) const{
+	auto in  = static_cast<const uint32_t*>( input_buffer );
+	auto out = static_cast<uint32_t*>( output_buffer );
+	
+	unsigned done = 0;
+#ifdef COLOR_LUT_AVX2
+	if( hasAvx2() )
+		done = executeAvx2( nodes.data(), size, in, out, pixels );
+#endif
+	executePixels( nodes.data(), size, in + done, out + done, pixels - done );
+}
+
+static uint32_t unpremultiply( uint32_t pixel ){
+	uint32_t alpha = pixel >> 24;
+	if( alpha == 255 || alpha == 0 )
+		return pixel;
+	
+	uint32_t result = pixel & 0xFF000000;
+	for( int shift=0; shift<24; shift+=8 ){
+		uint32_t color = ( pixel >> shift ) & 0xFF;
+		result |= min( ( color * 255 + alpha/2 ) / alpha, 255u ) << shift;
+	}
+	return result;
+}
+
+static uint32_t premultiply( uint32_t pixel ){
+	uint32_t alpha = pixel >> 24;
+	if( alpha == 255 )
+		return pixel;
+	
+	uint32_t result = pixel & 0xFF000000;
+	for( int shift=0; shift<24; shift+=8 ){
+		uint32_t color = ( pixel >> shift ) & 0xFF;
+		result |= ( ( color * alpha + 127 ) / 255 ) << shift;
+	}
+	return result;
+}
+
+void ColorLut::executePremultiplied( const void* input_buffer, void* output_buffer, unsigned pixels ) const{
+	auto in  = static_cast<const uint32_t*>( input_buffer );
+	auto out = static_cast<uint32_t*>( output_buffer );
+	
+	//The LUT needs the actual colors, so undo the alpha in chunks small enough to stay in the L1 cache
+	const unsigned chunk = 256;
+	uint32_t buffer[chunk];
+	for( unsigned done=0; done<pixels; done+=chunk ){
+		unsigned amount = min( chunk, pixels - done );
+		for( unsigned i=0; i<amount; i++ )
+			buffer[i] = unpremultiply( in[done+i] );
+		
+		execute( buffer, buffer, amount );
+		
+		for( unsigned i=0; i<amount; i++ )
+			out[done+i] = premultiply( buffer[i] );
+	}
+}
@@ -0,0 +1,56 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLOR_LUT_HPP
+#define COLOR_LUT_HPP
+
+#include <functional>
+#include <vector>
+
+/*
+	A color transform sampled into a 3D lookup table, which is then applied
+	to BGRA8 pixels with tetrahedral interpolation. This is much faster than
+	running the full transform for every pixel, at a small cost in accuracy
+	depending on the grid size. Alpha is kept as is, executePremultiplied()
+	is for pixels where the colors have been multiplied with alpha.
+*/
+class ColorLut{
+	public:
+		/** Transforms 'amount' RGB float triplets in the 0-1 range */
+		using Sampler = std::function<void( const float* in, float* out, unsigned amount )>;
+		
+		static const unsigned default_size = 33;
+		static const unsigned min_size = 2;
+		static const unsigned max_size = 129;
+	
+	private:
+		unsigned size{ 0 };
+		std::vector<float> nodes; //b, g, r, 0 for each node in the 0-255 range, blue changes fastest
+	
+	public:
+		ColorLut() { }
+		ColorLut( const Sampler& sample, unsigned grid_size = default_size );
+		
+		operator bool() const{ return size > 0; }
+		unsigned gridSize() const{ return size; }
+		
+		void execute( const void* input_buffer, void* output_buffer, unsigned pixels ) const;
+		void executePremultiplied( const void* input_buffer, void* output_buffer, unsigned pixels ) const;
+};
+
+
+#endif
@@ -0,0 +1,89 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DisplayTiles.hpp"
+#include "ParallelRows.hpp"
+
+#include <QPainter>
+
+using namespace std;
+
+void DisplayTiles::clear(){
+	tiles.clear();
+	key = 0;
+	size = {};
+}
+
+/** Calls 'func' with the index of each tile overlapping 'area' */
+template<typename Func>
+static void forTiles( QRect area, Func func ){
+	if( area.isEmpty() )
+		return;
+	for( int iy=area.top() / DisplayTiles::tile_size; iy<=area.bottom() / DisplayTiles::tile_size; iy++ )
+		for( int ix=area.left() / DisplayTiles::tile_size; ix<=area.right() / DisplayTiles::tile_size; ix++ )
+			func( QPoint( ix, iy ) );
+}
+
+vector<QPoint> DisplayTiles::missing( QRect area ) const{
+	vector<QPoint> wanted;
+	forTiles( area, [&]( QPoint index ){
+			if( tiles.find( { index.y(), index.x() } ) == tiles.end() )
+				wanted.push_back( index );
+		} );
+	return wanted;
+}
+
+vector<DisplayTiles::Tile> DisplayTiles::render( const QImage& source, QSize size, const vector<QPoint>& wanted, ResampleFilter filter ){
+	vector<Tile> made( wanted.size() );
+	
+	//Each tile is one "row", so threads take whole tiles
+	parallelRows( wanted.size(), tile_size * tile_size * 4, [&]( int first, int last ){
+			for( int i=first; i<last; i++ )
+				made[i] = { wanted[i], resample( source, size, tileArea( wanted[i] ), filter ) };
+		}, 0 );
+	
+	return made;
+}
+
+void DisplayTiles::reset( const QImage& source, QSize size ){
+	if( !isFor( source, size ) ){
+		tiles.clear();
+		key = source.cacheKey();
+		this->size = size;
+	}
+}
+
+void DisplayTiles::add( vector<Tile> made ){
+	for( auto& tile : made )
+		tiles[{ tile.first.y(), tile.first.x() }] = std::move( tile.second );
+}
+
+void DisplayTiles::trim( QRect keep ){
+	for( auto it = tiles.begin(); it != tiles.end(); )
+		if( tileArea( { it->first.second, it->first.first } ).intersects( keep ) )
+			++it;
+		else
+			it = tiles.erase( it );
+}
+
+void DisplayTiles::draw( QPainter& painter, QRect area ) const{
+	forTiles( area, [&]( QPoint index ){
+			auto it = tiles.find( { index.y(), index.x() } );
+			if( it != tiles.end() )
+				painter.drawImage( index * tile_size, it->second );
+		} );
+}
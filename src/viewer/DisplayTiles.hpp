@@ -0,0 +1,74 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DISPLAY_TILES_HPP
+#define DISPLAY_TILES_HPP
+
+#include "Resampler.hpp"
+
+#include <QImage>
+#include <QPoint>
+#include <QRect>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+class QPainter;
+
+/*
+	An image scaled to the zoom, made in tiles as they become visible.
+	Only the tiles in view are made, in parallel, and they are kept while
+	panning so only the tiles which come into view have to be made.
+*/
+class DisplayTiles{
+	public:
+		static const int tile_size = 256;
+		using Tile = std::pair<QPoint,QImage>; //Index and contents
+	
+	private:
+		qint64 key{ 0 }; //cacheKey() of the image the tiles are made from
+		QSize size;      //The size that image is scaled to
+		std::map<std::pair<int,int>,QImage> tiles; //Keyed by row and column
+		
+		static QRect tileArea( QPoint index ){ return { index * tile_size, QSize( tile_size, tile_size ) }; }
+	
+	public:
+		/** @return true if the tiles are of 'source' scaled to 'size' */
+		bool isFor( const QImage& source, QSize size ) const
+			{ return key == source.cacheKey() && this->size == size; }
+		void clear();
+		
+		/** Starts over for 'source' scaled to 'size', unless the tiles are for that already */
+		void reset( const QImage& source, QSize size );
+		
+		/** @return The tiles overlapping 'area' which have not been made yet */
+		std::vector<QPoint> missing( QRect area ) const;
+		
+		/** Resamples the 'wanted' tiles of 'source' scaled to 'size' in parallel */
+		static std::vector<Tile> render( const QImage& source, QSize size, const std::vector<QPoint>& wanted, ResampleFilter filter );
+		void add( std::vector<Tile> made );
+		
+		/** Forgets the tiles not overlapping 'keep' */
+		void trim( QRect keep );
+		
+		/** Draws the tiles overlapping 'area', at their position in the scaled image */
+		void draw( QPainter& painter, QRect area ) const;
+};
+
+
+#endif
@@ -0,0 +1,59 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameRing.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+void FrameRing::reset( QSize size ){
+	if( this->size != size ){
+		frames.clear();
+		this->size = size;
+	}
+}
+
+int FrameRing::capacity() const{
+	qint64 frame_bytes = max( size.width() * qint64(size.height()) * 4, qint64(1) );
+	return max( budget / frame_bytes, qint64(1) );
+}
+
+QImage FrameRing::get( int index, const QImage& source ) const{
+	auto it = frames.find( index );
+	if( it == frames.end() || it->second.key != source.cacheKey() || it->second.image.size() != size )
+		return {};
+	return it->second.image;
+}
+
+void FrameRing::add( vector<Frame> made, int current, int frame_amount ){
+	for( auto& frame : made )
+		if( frame.image.size() == size )
+			frames[frame.index] = std::move( frame );
+	if( frame_amount < 1 )
+		return;
+	
+	//How long until a frame is shown again
+	auto distance = [=]( int index ){ return ( index - current + frame_amount ) % frame_amount; };
+	
+	while( (int)frames.size() > capacity() ){
+		auto last = max_element( frames.begin(), frames.end(), [&]( const pair<const int,Frame>& a, const pair<const int,Frame>& b ){
+				return distance( a.first ) < distance( b.first );
+			} );
+		frames.erase( last );
+	}
+}
@@ -0,0 +1,63 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAME_RING_HPP
+#define FRAME_RING_HPP
+
+#include <QImage>
+
+#include <map>
+#include <vector>
+
+/*
+	Animation frames scaled to the zoom ahead of the playhead, limited by a
+	memory budget. When it is full, the frames which will be shown last are
+	dropped first, which are the ones just played. Looping animations which
+	fit in the budget are only scaled once.
+*/
+class FrameRing{
+	public:
+		struct Frame{
+			int index;
+			qint64 key; //cacheKey() of the frame it was scaled from
+			QImage image;
+		};
+	
+	private:
+		qint64 budget; //In bytes
+		QSize size;    //The size the frames are scaled to
+		std::map<int,Frame> frames;
+	
+	public:
+		explicit FrameRing( qint64 budget ) : budget( budget ) { }
+		
+		void clear(){ frames.clear(); }
+		/** Starts over for frames scaled to 'size', unless they are for that already */
+		void reset( QSize size );
+		
+		/** @return The amount of frames which fit in the budget */
+		int capacity() const;
+		
+		/** @return Frame 'index' made from 'source', or a null image if it has not been made */
+		QImage get( int index, const QImage& source ) const;
+		
+		/** Adds frames, and drops the frames shown last after 'current' when over the budget */
+		void add( std::vector<Frame> made, int current, int frame_amount );
+};
+
+
+#endif
@@ -0,0 +1,38 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAME_SOURCE_HPP
+#define FRAME_SOURCE_HPP
+
+#include <QImage>
+
+/*
+	Decodes the frames of an animation in order, for animations which are
+	decoded while they are shown instead of being kept in memory.
+*/
+class FrameSource{
+	public:
+		virtual ~FrameSource(){ }
+		
+		/** Decodes the next frame and how long it is shown, @return false if there are no more */
+		virtual bool read( QImage& frame, int& delay ) = 0;
+		/** Starts over from the first frame */
+		virtual bool restart() = 0;
+};
+
+
+#endif
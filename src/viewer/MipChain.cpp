@@ -0,0 +1,97 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MipChain.hpp"
+#include "ParallelRows.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define MIP_CHAIN_SSE2
+	#include <emmintrin.h>
+#endif
+
+bool MipChain::wanted( const QImage& image ){
+	return image.depth() == 32
+		&&	image.width() * qint64(image.height()) >= min_pixels
+		&&	image.width() / 2 >= min_size && image.height() / 2 >= min_size;
+}
+
+MipChain::MipChain( const QImage& image ){
+	if( !wanted( image ) )
+		return;
+	
+	const QImage* previous = &image;
+	while( previous->width() / 2 >= min_size && previous->height() / 2 >= min_size ){
+		levels.push_back( halved( *previous ) );
+		previous = &levels.back();
+	}
+}
+
+const QImage& MipChain::level( const QImage& original, QSize size ) const{
+	for( auto it = levels.rbegin(); it != levels.rend(); ++it )
+		if( it->width() >= size.width() && it->height() >= size.height() )
+			return *it;
+	return original;
+}
+
+
+/** Averages 2x2 blocks of the two input rows into 'width' output pixels */
+static void halveRow( const uint8_t* in1, const uint8_t* in2, uint8_t* out, int width ){
+	int ix = 0;
+#ifdef MIP_CHAIN_SSE2
+	//Two output pixels at a time, with each channel widened to 16 bits
+	auto zero = _mm_setzero_si128();
+	auto round = _mm_set1_epi16( 2 );
+	for( ; ix+2<=width; ix+=2 ){
+		auto row1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in1 + ix*8 ) );
+		auto row2 = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in2 + ix*8 ) );
+		auto left  = _mm_add_epi16( _mm_unpacklo_epi8( row1, zero ), _mm_unpacklo_epi8( row2, zero ) );
+		auto right = _mm_add_epi16( _mm_unpackhi_epi8( row1, zero ), _mm_unpackhi_epi8( row2, zero ) );
+		
+		//Add the neighbouring pixels, which are in each half of the registers
+		left  = _mm_add_epi16( left,  _mm_srli_si128( left,  8 ) );
+		right = _mm_add_epi16( right, _mm_srli_si128( right, 8 ) );
+		auto sum = _mm_unpacklo_epi64( left, right );
+		
+		auto average = _mm_srli_epi16( _mm_add_epi16( sum, round ), 2 );
+		_mm_storel_epi64( reinterpret_cast<__m128i*>( out + ix*4 ), _mm_packus_epi16( average, average ) );
+	}
+#endif
+	for( ; ix<width; ix++ )
+		for( int c=0; c<4; c++ )
+			out[ix*4+c] = ( in1[ix*8+c] + in1[ix*8+4+c] + in2[ix*8+c] + in2[ix*8+4+c] + 2 ) / 4;
+}
+
+QImage MipChain::halved( const QImage& image ){
+	QImage output( std::max( image.width() / 2, 1 ), std::max( image.height() / 2, 1 ), image.format() );
+	if( image.width() < 2 || image.height() < 2 )
+		return image.scaled( output.size() );
+	
+	auto in = image.constBits();
+	auto out = output.bits();
+	auto in_line = image.bytesPerLine();
+	auto out_line = output.bytesPerLine();
+	int width = output.width();
+	parallelRows( output.height(), in_line*2, [=]( int first, int last ){
+			for( int iy=first; iy<last; iy++ )
+				halveRow( in + iy*2*in_line, in + (iy*2+1)*in_line, out + iy*out_line, width );
+		} );
+	
+	return output;
+}
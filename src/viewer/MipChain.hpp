@@ -0,0 +1,54 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MIP_CHAIN_HPP
+#define MIP_CHAIN_HPP
+
+#include <QImage>
+#include <vector>
+
+/*
+	Progressively halved versions of an image, made with a 2x2 box filter.
+	Scaling down from the nearest level is both faster and aliases less
+	than scaling the full image. Only images with 32-bit pixels are
+	supported, which includes premultiplied alpha.
+*/
+class MipChain{
+	public:
+		static const int min_size = 128; //No levels smaller than this are made
+		static const int min_pixels = 2*1024*1024; //Smaller images don't benefit enough
+	
+	private:
+		std::vector<QImage> levels; //The first level is half the size of the original
+	
+	public:
+		MipChain() { }
+		explicit MipChain( const QImage& image );
+		
+		bool empty() const{ return levels.empty(); }
+		
+		/** @return true if a chain would be made for 'image' */
+		static bool wanted( const QImage& image );
+		
+		/** @return The smallest level which is at least 'size', or 'original' if there is none */
+		const QImage& level( const QImage& original, QSize size ) const;
+		
+		static QImage halved( const QImage& image );
+};
+
+
+#endif
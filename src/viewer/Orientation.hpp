@@ -19,6 +19,7 @@
 #define ORIENTATION_HPP
 
 #include <QSize>
+#include <QTransform>
 
 struct Orientation{
 	int8_t rotation{ 0 };
@@ -58,6 +59,17 @@ struct Orientation{
 			return QSize( before.height(), before.width() );
 	}
 	
+	/** @return Maps an image of size 'before' to this orientation, with its corner at 0,0 */
+	QTransform transform( QSize before ) const{
+		auto normal = normalized();
+		QTransform rotated;
+		rotated.rotate( normal.rotation * 90 );
+		auto oriented = rotated * QTransform::fromScale( normal.flip_hor ? -1 : 1, normal.flip_ver ? -1 : 1 );
+		
+		auto bounds = oriented.mapRect( QRectF( QPointF(), QSizeF( before ) ) );
+		return oriented * QTransform::fromTranslate( -bounds.x(), -bounds.y() );
+	}
+	
 	Orientation mirror( bool hor, bool ver )
 		{ return { rotation, ver?!flip_ver:flip_ver, hor?!flip_hor:flip_hor };	}
 	
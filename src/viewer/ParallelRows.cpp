@@ -0,0 +1,166 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ParallelRows.hpp"
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <qglobal.h>
+#ifdef Q_OS_LINUX
+	#include <unistd.h>
+#endif
+
+using namespace std;
+
+static long l2CacheSize(){
+	static const long fallback = 256 * 1024;
+#if defined(Q_OS_LINUX) && defined(_SC_LEVEL2_CACHE_SIZE)
+	static const long size = sysconf( _SC_LEVEL2_CACHE_SIZE );
+	return size > 0 ? size : fallback;
+#else
+	return fallback;
+#endif
+}
+
+int rowBandHeight( int bytes_per_line ){
+	//Use half of it, the rest is for whatever tables the work needs
+	return max( 1L, l2CacheSize() / 2 / max( bytes_per_line, 1 ) );
+}
+
+
+//The bands a thread has left, both ends are packed into one value so the
+//owner (taking from the front) and thieves (taking from the back) can't
+//take the same band
+class BandRange{
+	private:
+		atomic<uint64_t> range{ 0 };
+		
+		static uint64_t pack( uint32_t begin, uint32_t end ){ return (uint64_t(begin) << 32) | end; }
+		static uint32_t begin( uint64_t range ){ return range >> 32; }
+		static uint32_t end(   uint64_t range ){ return range & 0xFFFFFFFF; }
+	
+	public:
+		void set( uint32_t begin, uint32_t end ){ range = pack( begin, end ); }
+		
+		bool takeFront( int& band ){
+			auto current = range.load();
+			while( begin(current) < end(current) )
+				if( range.compare_exchange_weak( current, pack( begin(current)+1, end(current) ) ) ){
+					band = begin(current);
+					return true;
+				}
+			return false;
+		}
+		
+		bool takeBack( int& band ){
+			auto current = range.load();
+			while( begin(current) < end(current) )
+				if( range.compare_exchange_weak( current, pack( begin(current), end(current)-1 ) ) ){
+					band = end(current) - 1;
+					return true;
+				}
+			return false;
+		}
+};
+
+struct BandSchedule{
+	const RowFunction& process;
+	int height;
+	int band_height;
+	vector<BandRange> ranges;
+	
+	atomic<int> remaining;
+	QMutex mutex;
+	QWaitCondition finished;
+	
+	BandSchedule( const RowFunction& process, int height, int band_height, int bands, int threads )
+		:	process(process), height(height), band_height(band_height), ranges(threads), remaining(bands) {
+		for( int i=0; i<threads; i++ )
+			ranges[i].set( bands * i / threads, bands * (i+1) / threads );
+	}
+	
+	void runBand( int band ){
+		int first = band * band_height;
+		process( first, min( first + band_height, height ) );
+		
+		if( --remaining == 0 ){
+			QMutexLocker locker( &mutex );
+			finished.wakeAll();
+		}
+	}
+	
+	void work( unsigned self ){
+		//Own bands first, in order so memory is read sequentially
+		int band;
+		while( ranges[self].takeFront( band ) )
+			runBand( band );
+		
+		//Then help the others, starting from the end of their share
+		for( unsigned i=1; i<ranges.size(); i++ )
+			while( ranges[(self+i) % ranges.size()].takeBack( band ) )
+				runBand( band );
+	}
+	
+	void wait(){
+		QMutexLocker locker( &mutex );
+		while( remaining > 0 )
+			finished.wait( &mutex );
+	}
+};
+
+class BandWorker : public QRunnable{
+	private:
+		shared_ptr<BandSchedule> schedule; //Might start after all bands are done
+		unsigned self;
+	
+	public:
+		BandWorker( shared_ptr<BandSchedule> schedule, unsigned self ) : schedule(schedule), self(self) { }
+		void run(){ schedule->work( self ); }
+};
+
+void parallelRows( int height, int bytes_per_line, const RowFunction& process, int inline_bytes ){
+	if( height <= 0 )
+		return;
+	
+	auto pool = QThreadPool::globalInstance();
+	int band_height = rowBandHeight( bytes_per_line );
+	int bands = ( height + band_height - 1 ) / band_height;
+	int threads = min( bands, pool->maxThreadCount() );
+	
+	//Not worth the overhead of starting threads
+	if( threads <= 1 || int64_t(height) * bytes_per_line <= inline_bytes ){
+		process( 0, height );
+		return;
+	}
+	
+	auto schedule = make_shared<BandSchedule>( process, height, band_height, bands, threads );
+	for( int i=1; i<threads; i++ )
+		pool->start( new BandWorker( schedule, i ) );
+	
+	schedule->work( 0 );
+	schedule->wait();
+}
@@ -0,0 +1,39 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARALLEL_ROWS_HPP
+#define PARALLEL_ROWS_HPP
+
+#include <functional>
+
+/** Processes the rows [first, last) */
+using RowFunction = std::function<void( int first, int last )>;
+
+/** @return The amount of rows in a band, so a band fits in the L2 cache */
+int rowBandHeight( int bytes_per_line );
+
+/*
+	Splits the rows of an image into bands and processes them on the global
+	QThreadPool, the calling thread helps as well. Each thread starts with
+	an equal share of bands, and steals bands from the others when it runs
+	out. Images smaller than 'inline_bytes' are processed on the calling
+	thread directly.
+*/
+void parallelRows( int height, int bytes_per_line, const RowFunction& process, int inline_bytes = 512*1024 );
+
+
+#endif
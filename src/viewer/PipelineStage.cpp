@@ -0,0 +1,135 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PipelineStage.hpp"
+
+#include <QThread>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+class PipelineStage::Worker : public QThread{
+	private:
+		PipelineStage& stage;
+	
+	protected:
+		void run(){ stage.work(); }
+	
+	public:
+		Worker( PipelineStage& stage ) : stage(stage) { }
+};
+
+
+PipelineStage::PipelineStage( QString name, int threads, int capacity )
+	:	name(name), capacity(std::max( capacity, 1 )) {
+	clock.start();
+	
+	threads = std::max( threads, 1 );
+	for( int i=0; i<threads; i++ ){
+		workers.push_back( std::make_unique<Worker>( *this ) );
+		workers.back()->start();
+	}
+}
+
+PipelineStage::~PipelineStage(){
+	{	QMutexLocker locker( &mutex );
+		stopping = true;
+		queue.clear(); //Unstarted work is simply dropped
+		has_tasks.wakeAll();
+		has_room.wakeAll();
+	}
+	
+	for( auto& worker : workers )
+		worker->wait();
+}
+
+void PipelineStage::enqueue( Task&& task, bool urgent ){
+	Entry entry{ std::move(task), clock.nsecsElapsed() };
+	if( urgent )
+		queue.push_front( std::move(entry) );
+	else
+		queue.push_back( std::move(entry) );
+	max_queued = std::max( max_queued, int(queue.size()) );
+	has_tasks.wakeOne();
+}
+
+bool PipelineStage::try_push( Task task ){
+	QMutexLocker locker( &mutex );
+	if( stopping || int(queue.size()) >= capacity )
+		return false;
+	
+	enqueue( std::move(task) );
+	return true;
+}
+
+void PipelineStage::push( Task task ){
+	QMutexLocker locker( &mutex );
+	while( !stopping && int(queue.size()) >= capacity )
+		has_room.wait( &mutex );
+	
+	if( !stopping )
+		enqueue( std::move(task) );
+}
+
+void PipelineStage::push_urgent( Task task ){
+	QMutexLocker locker( &mutex );
+	if( !stopping )
+		enqueue( std::move(task), true );
+}
+
+void PipelineStage::work(){
+	QMutexLocker locker( &mutex );
+	while( true ){
+		while( !stopping && queue.empty() )
+			has_tasks.wait( &mutex );
+		if( stopping )
+			return;
+		
+		auto entry = std::move( queue.front() );
+		queue.pop_front();
+		has_room.wakeOne();
+		
+		running++;
+		auto started = clock.nsecsElapsed();
+		total_wait += started - entry.queued_at;
+		
+		locker.unlock();
+		entry.task();
+		entry.task = {}; //Release whatever the task was holding before locking
+		locker.relock();
+		
+		running--;
+		processed++;
+		total_run += clock.nsecsElapsed() - started;
+	}
+}
+
+PipelineStage::Stats PipelineStage::stats() const{
+	QMutexLocker locker( &mutex );
+	
+	Stats s;
+	s.name       = name;
+	s.threads    = workers.size();
+	s.capacity   = capacity;
+	s.queued     = queue.size();
+	s.running    = running;
+	s.max_queued = max_queued;
+	s.processed  = processed;
+	s.wait_ms    = processed ? total_wait / 1000000.0 / processed : 0.0;
+	s.run_ms     = processed ? total_run  / 1000000.0 / processed : 0.0;
+	return s;
+}
@@ -0,0 +1,94 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIPELINE_STAGE_HPP
+#define PIPELINE_STAGE_HPP
+
+#include <QString>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*
+	One step of the loading pipeline. Tasks are kept in a bounded queue
+	and executed by a fixed amount of worker threads, so each stage has
+	its own concurrency limit. A stage pushing into the next one with
+	push() blocks while that queue is full, which throttles the earlier
+	stages instead of letting work pile up in memory.
+*/
+class PipelineStage{
+	public:
+		using Task = std::function<void()>;
+		
+		struct Stats{
+			QString name;
+			int threads;
+			int capacity;
+			int queued;              //Tasks waiting to be started
+			int running;             //Tasks currently being executed
+			int max_queued;          //Highest amount of waiting tasks seen
+			unsigned long processed; //Finished tasks
+			double wait_ms;          //Average time a task waited in the queue
+			double run_ms;           //Average time it took to execute a task
+		};
+	
+	private:
+		class Worker;
+		struct Entry{
+			Task task;
+			qint64 queued_at;
+		};
+		
+		QString name;
+		int capacity;
+		
+		mutable QMutex mutex;
+		QWaitCondition has_tasks;
+		QWaitCondition has_room;
+		std::deque<Entry> queue;
+		std::vector<std::unique_ptr<Worker>> workers;
+		QElapsedTimer clock;
+		bool stopping{ false };
+		
+		int running{ 0 };
+		int max_queued{ 0 };
+		unsigned long processed{ 0 };
+		qint64 total_wait{ 0 };
+		qint64 total_run{ 0 };
+		
+		void enqueue( Task&& task, bool urgent=false );
+		void work();
+	
+	public:
+		PipelineStage( QString name, int threads, int capacity );
+		PipelineStage( const PipelineStage& ) = delete;
+		~PipelineStage();
+		
+		bool try_push( Task task ); //Returns false if the queue is full
+		void push( Task task );     //Waits until the queue has room
+		void push_urgent( Task task ); //Runs before anything else, ignoring the capacity
+		
+		Stats stats() const;
+};
+
+
+#endif
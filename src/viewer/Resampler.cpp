@@ -0,0 +1,244 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Resampler.hpp"
+#include "ParallelRows.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define RESAMPLER_SSE2
+	#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+
+/** The input pixels contributing to the output pixels [offset, offset+amount) along one axis */
+struct Weights{
+	int taps;                   //Amount of input pixels for each output pixel
+	std::vector<int> first;     //First input pixel for each output pixel
+	std::vector<float> weights; //'taps' weights for each output pixel
+	
+	Weights( int in_size, int out_size, ResampleFilter filter, int offset, int amount );
+	const float* of( int index ) const{ return weights.data() + index * taps; }
+};
+
+static double lanczos3( double x ){
+	x = abs( x );
+	if( x < 1e-8 )
+		return 1.0;
+	if( x >= 3.0 )
+		return 0.0;
+	
+	const double pi = 3.14159265358979323846;
+	return 3.0 * sin( pi * x ) * sin( pi * x / 3.0 ) / ( pi * pi * x * x );
+}
+
+Weights::Weights( int in_size, int out_size, ResampleFilter filter, int offset, int amount ){
+	double scale = double(out_size) / in_size;
+	double inverse = 1.0 / scale;
+	double stretch = min( scale, 1.0 ); //Widen the filter when scaling down, to avoid aliasing
+	double support = filter == ResampleFilter::AREA ? 0.5 * max( inverse, 1.0 ) : 3.0 / stretch;
+	
+	taps = min( int( ceil( support * 2 ) ) + 2, in_size );
+	first.resize( amount );
+	weights.assign( amount * taps, 0.0f );
+	
+	for( int i=0; i<amount; i++ ){
+		//Pixel centers are at +0.5
+		double center = ( offset + i + 0.5 ) * inverse;
+		first[i] = max( 0, min( int( floor( center - support ) ), in_size - taps ) );
+		
+		double total = 0.0;
+		std::vector<double> values( taps );
+		for( int t=0; t<taps; t++ ){
+			double pos = first[i] + t;
+			if( filter == ResampleFilter::AREA ){
+				double low  = max( pos,       center - support );
+				double high = min( pos + 1.0, center + support );
+				values[t] = max( high - low, 0.0 );
+			}
+			else
+				values[t] = lanczos3( ( pos + 0.5 - center ) * stretch );
+			total += values[t];
+		}
+		
+		for( int t=0; t<taps; t++ )
+			weights[i*taps + t] = total != 0.0 ? values[t] / total : ( t == 0 );
+	}
+}
+
+
+/** Resamples one row horizontally into 4 floats per pixel, 'widened' is space for the input row as floats */
+static void resampleRow( const uint8_t* in, float* out, float* widened, const Weights& horizontal, int width ){
+	//Convert the used part once, as each input pixel is used by several output pixels
+	int i = horizontal.first[0] * 4;
+	int end = ( horizontal.first[width-1] + horizontal.taps ) * 4;
+#ifdef RESAMPLER_SSE2
+	auto zero = _mm_setzero_si128();
+	for( ; i+16<=end; i+=16 ){
+		auto bytes = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + i ) );
+		auto low  = _mm_unpacklo_epi8( bytes, zero );
+		auto high = _mm_unpackhi_epi8( bytes, zero );
+		_mm_storeu_ps( widened + i,      _mm_cvtepi32_ps( _mm_unpacklo_epi16( low,  zero ) ) );
+		_mm_storeu_ps( widened + i + 4,  _mm_cvtepi32_ps( _mm_unpackhi_epi16( low,  zero ) ) );
+		_mm_storeu_ps( widened + i + 8,  _mm_cvtepi32_ps( _mm_unpacklo_epi16( high, zero ) ) );
+		_mm_storeu_ps( widened + i + 12, _mm_cvtepi32_ps( _mm_unpackhi_epi16( high, zero ) ) );
+	}
+#endif
+	for( ; i<end; i++ )
+		widened[i] = in[i];
+	
+	for( int ix=0; ix<width; ix++ ){
+		auto pixels = widened + horizontal.first[ix] * 4;
+		auto weights = horizontal.of( ix );
+#ifdef RESAMPLER_SSE2
+		//Two sums, so the additions don't have to wait on each other
+		auto sum1 = _mm_setzero_ps();
+		auto sum2 = _mm_setzero_ps();
+		int t = 0;
+		for( ; t+2<=horizontal.taps; t+=2 ){
+			sum1 = _mm_add_ps( sum1, _mm_mul_ps( _mm_loadu_ps( pixels + t*4     ), _mm_set1_ps( weights[t]   ) ) );
+			sum2 = _mm_add_ps( sum2, _mm_mul_ps( _mm_loadu_ps( pixels + t*4 + 4 ), _mm_set1_ps( weights[t+1] ) ) );
+		}
+		if( t < horizontal.taps )
+			sum1 = _mm_add_ps( sum1, _mm_mul_ps( _mm_loadu_ps( pixels + t*4 ), _mm_set1_ps( weights[t] ) ) );
+		_mm_storeu_ps( out + ix*4, _mm_add_ps( sum1, sum2 ) );
+#else
+		for( int c=0; c<4; c++ ){
+			float sum = 0;
+			for( int t=0; t<horizontal.taps; t++ )
+				sum += pixels[t*4+c] * weights[t];
+			out[ix*4+c] = sum;
+		}
+#endif
+	}
+}
+
+/** sum += row * weight, for 'amount' floats */
+static void addWeighted( float* sum, const float* row, float weight, int amount ){
+	int i = 0;
+#ifdef RESAMPLER_SSE2
+	auto factor = _mm_set1_ps( weight );
+	for( ; i+4<=amount; i+=4 )
+		_mm_storeu_ps( sum + i, _mm_add_ps( _mm_loadu_ps( sum + i ), _mm_mul_ps( _mm_loadu_ps( row + i ), factor ) ) );
+#endif
+	for( ; i<amount; i++ )
+		sum[i] += row[i] * weight;
+}
+
+/** Converts 4 floats per pixel back to 8-bit, premultiplied colors are limited to alpha */
+static void storeRow( const float* in, uint8_t* out, int width, bool premultiplied ){
+	for( int ix=0; ix<width; ix++ ){
+#ifdef RESAMPLER_SSE2
+		auto pixel = _mm_loadu_ps( in + ix*4 );
+		pixel = _mm_max_ps( pixel, _mm_setzero_ps() );
+		if( premultiplied )
+			pixel = _mm_min_ps( pixel, _mm_shuffle_ps( pixel, pixel, _MM_SHUFFLE(3,3,3,3) ) );
+		auto packed = _mm_cvtps_epi32( pixel );
+		packed = _mm_packs_epi32( packed, packed );
+		packed = _mm_packus_epi16( packed, packed );
+		int32_t result = _mm_cvtsi128_si32( packed );
+		memcpy( out + ix*4, &result, 4 );
+#else
+		float alpha = min( max( in[ix*4+3], 0.0f ), 255.0f );
+		for( int c=0; c<4; c++ ){
+			float limit = ( premultiplied && c < 3 ) ? alpha : 255.0f;
+			out[ix*4+c] = uint8_t( min( max( in[ix*4+c], 0.0f ), limit ) + 0.5f );
+		}
+#endif
+	}
+}
+
+/** Resamples the rows [first, last) of the area the weights are for, 'out' is the top-left of that area */
+static void resampleRows( const QImage& source, const Weights& horizontal, const Weights& vertical, bool premultiplied, uint8_t* out, int out_line, int first, int last ){
+	const int width = horizontal.first.size();
+	const int floats = width * 4;
+	
+	//Only the input rows needed by these rows are resampled horizontally
+	int row_first = vertical.first[first];
+	int row_last  = vertical.first[last-1] + vertical.taps;
+	
+	std::vector<float> rows( ( row_last - row_first ) * floats );
+	std::vector<float> widened( source.width() * 4 );
+	for( int iy=row_first; iy<row_last; iy++ )
+		resampleRow( source.constScanLine( iy ), rows.data() + ( iy - row_first ) * floats, widened.data(), horizontal, width );
+	
+	std::vector<float> sum( floats );
+	for( int iy=first; iy<last; iy++ ){
+		fill( sum.begin(), sum.end(), 0.0f );
+		auto weights = vertical.of( iy );
+		for( int t=0; t<vertical.taps; t++ ){
+			if( weights[t] == 0.0f )
+				continue;
+			auto row = rows.data() + ( vertical.first[iy] + t - row_first ) * floats;
+			addWeighted( sum.data(), row, weights[t], floats );
+		}
+		storeRow( sum.data(), out + iy * out_line, width, premultiplied );
+	}
+}
+
+static QImage supportedFormat( const QImage& image ){
+	return image.depth() == 32 ? image : image.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+}
+
+QImage resample( const QImage& image, QSize size, ResampleFilter filter ){
+	if( image.isNull() || size.isEmpty() )
+		return {};
+	if( image.size() == size )
+		return image;
+	
+	auto source = supportedFormat( image );
+	bool premultiplied = source.format() == QImage::Format_ARGB32_Premultiplied;
+	
+	QImage output( size, source.format() );
+	Weights horizontal( source.width(),  size.width(),  filter, 0, size.width()  );
+	Weights vertical(   source.height(), size.height(), filter, 0, size.height() );
+	
+	//Each band only resamples the input rows it needs horizontally, so the
+	//intermediate rows stay in the cache. Size the bands by that buffer.
+	double rows_per_line = double(source.height()) / size.height();
+	int band_bytes = int( size.width() * 4 * sizeof(float) * max( rows_per_line, 1.0 ) );
+	parallelRows( size.height(), band_bytes, [&]( int first, int last ){
+			resampleRows( source, horizontal, vertical, premultiplied, output.bits(), output.bytesPerLine(), first, last );
+		} );
+	
+	return output;
+}
+
+QImage resample( const QImage& image, QSize size, QRect area, ResampleFilter filter ){
+	area &= QRect( QPoint(), size );
+	if( image.isNull() || area.isEmpty() )
+		return {};
+	if( image.size() == size )
+		return image.copy( area );
+	
+	auto source = supportedFormat( image );
+	bool premultiplied = source.format() == QImage::Format_ARGB32_Premultiplied;
+	
+	QImage output( area.size(), source.format() );
+	Weights horizontal( source.width(),  size.width(),  filter, area.x(), area.width()  );
+	Weights vertical(   source.height(), size.height(), filter, area.y(), area.height() );
+	resampleRows( source, horizontal, vertical, premultiplied, output.bits(), output.bytesPerLine(), 0, area.height() );
+	
+	return output;
+}
@@ -0,0 +1,40 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESAMPLER_HPP
+#define RESAMPLER_HPP
+
+#include <QImage>
+
+enum class ResampleFilter{
+	AREA,    //Average of the covered area, sharp edges but no ringing
+	LANCZOS3 //Sharper, but might ring slightly around edges
+};
+
+/*
+	Separable high quality resampling intended for scaling down. Rows are
+	processed in bands on all cores, and the inner loops use SSE2 where
+	available. Images with 32-bit pixels keep their format, premultiplied
+	alpha included. Other formats are converted to premultiplied ARGB32.
+*/
+QImage resample( const QImage& image, QSize size, ResampleFilter filter = ResampleFilter::LANCZOS3 );
+
+/** Only makes 'area' of the resampled image, on the calling thread, so several areas can be made in parallel */
+QImage resample( const QImage& image, QSize size, QRect area, ResampleFilter filter = ResampleFilter::LANCZOS3 );
+
+
+#endif
@@ -0,0 +1,172 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Rotation.hpp"
+#include "ParallelRows.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+	#define ROTATION_SSE2
+	#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+static const int tile_size = 64; //64x64 pixels in and out fits in the L1 cache
+
+//Where an output pixel is found in the source, moving one output pixel moves exactly one source pixel
+struct PixelMap{
+	int x0, y0; //The source pixel of output pixel 0,0
+	int xx, xy; //Source movement when moving along an output row
+	int yx, yy; //Source movement when moving to the next output row
+	
+	int sourceX( int x, int y ) const{ return x0 + xx*x + yx*y; }
+	int sourceY( int x, int y ) const{ return y0 + xy*x + yy*y; }
+	bool transposed() const{ return xx == 0; }
+};
+
+static PixelMap pixelMap( const QTransform& orientation ){
+	auto inverse = orientation.inverted();
+	auto source = [&]( int x, int y ){
+			auto pos = inverse.map( QPointF( x + 0.5, y + 0.5 ) );
+			return QPoint( floor( pos.x() ), floor( pos.y() ) );
+		};
+	
+	auto origin = source( 0, 0 );
+	auto along_x = source( 1, 0 ) - origin;
+	auto along_y = source( 0, 1 ) - origin;
+	return { origin.x(), origin.y(), along_x.x(), along_x.y(), along_y.x(), along_y.y() };
+}
+
+class PixelAccess{
+	private:
+		const uint8_t* bits;
+		int bytes_per_line;
+	
+	public:
+		PixelAccess( const QImage& image ) : bits( image.constBits() ), bytes_per_line( image.bytesPerLine() ) { }
+		const uint32_t* line( int y ) const{ return reinterpret_cast<const uint32_t*>( bits + y * bytes_per_line ); }
+		uint32_t pixel( int x, int y ) const{ return line( y )[x]; }
+};
+
+
+/** Copies 'width' pixels, 'in' is the pixel for out[0] and the rest follow in the direction of 'step' */
+static void copyRow( const uint32_t* in, uint32_t* out, int width, int step ){
+	if( step == 1 ){
+		memcpy( out, in, width * sizeof(uint32_t) );
+		return;
+	}
+	
+	int ix = 0;
+#ifdef ROTATION_SSE2
+	for( ; ix+4<=width; ix+=4 ){
+		auto pixels = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in - ix - 3 ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( out + ix ), _mm_shuffle_epi32( pixels, _MM_SHUFFLE( 0,1,2,3 ) ) );
+	}
+#endif
+	for( ; ix<width; ix++ )
+		out[ix] = in[-ix];
+}
+
+#ifdef ROTATION_SSE2
+/** Writes the 4x4 output block at x,y, which is a transposed 4x4 block of the source */
+static void transposeBlock( const PixelAccess& in, uint32_t* out, int out_stride, const PixelMap& map, int x, int y ){
+	//Each output column is a source row, and each output row a source column
+	int first_column = map.sourceX( x, y ) - ( map.yx < 0 ? 3 : 0 );
+	__m128i rows[4];
+	for( int i=0; i<4; i++ ){
+		rows[i] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in.line( map.sourceY( x+i, y ) ) + first_column ) );
+		if( map.yx < 0 )
+			rows[i] = _mm_shuffle_epi32( rows[i], _MM_SHUFFLE( 0,1,2,3 ) );
+	}
+	
+	auto low01  = _mm_unpacklo_epi32( rows[0], rows[1] );
+	auto low23  = _mm_unpacklo_epi32( rows[2], rows[3] );
+	auto high01 = _mm_unpackhi_epi32( rows[0], rows[1] );
+	auto high23 = _mm_unpackhi_epi32( rows[2], rows[3] );
+	
+	auto store = [&]( int row, __m128i pixels )
+		{ _mm_storeu_si128( reinterpret_cast<__m128i*>( out + (y+row) * out_stride + x ), pixels ); };
+	store( 0, _mm_unpacklo_epi64( low01,  low23  ) );
+	store( 1, _mm_unpackhi_epi64( low01,  low23  ) );
+	store( 2, _mm_unpacklo_epi64( high01, high23 ) );
+	store( 3, _mm_unpackhi_epi64( high01, high23 ) );
+}
+#endif
+
+/** Fills the output rows [first, last) of a rotated image, one tile at a time */
+static void transposeRows( const PixelAccess& in, uint32_t* out, int out_stride, int width, const PixelMap& map, int first, int last ){
+	for( int ty=first; ty<last; ty+=tile_size )
+		for( int tx=0; tx<width; tx+=tile_size ){
+			int y_end = min( ty + tile_size, last );
+			int x_end = min( tx + tile_size, width );
+			
+			int iy = ty;
+#ifdef ROTATION_SSE2
+			for( ; iy+4<=y_end; iy+=4 ){
+				int ix = tx;
+				for( ; ix+4<=x_end; ix+=4 )
+					transposeBlock( in, out, out_stride, map, ix, iy );
+				for( ; ix<x_end; ix++ )
+					for( int i=0; i<4; i++ )
+						out[(iy+i)*out_stride + ix] = in.pixel( map.sourceX( ix, iy+i ), map.sourceY( ix, iy+i ) );
+			}
+#endif
+			for( ; iy<y_end; iy++ )
+				for( int ix=tx; ix<x_end; ix++ )
+					out[iy*out_stride + ix] = in.pixel( map.sourceX( ix, iy ), map.sourceY( ix, iy ) );
+		}
+}
+
+QImage orientImage( const QImage& image, const QTransform& orientation ){
+	if( image.isNull() || orientation.isIdentity() )
+		return image;
+	if( image.depth() != 32 )
+		return image.transformed( orientation );
+	
+	auto size = orientation.mapRect( QRectF( image.rect() ) ).toRect().size();
+	QImage out( size, image.format() );
+	if( out.isNull() )
+		return out;
+	out.setDotsPerMeterX( orientation.isRotating() ? image.dotsPerMeterY() : image.dotsPerMeterX() );
+	out.setDotsPerMeterY( orientation.isRotating() ? image.dotsPerMeterX() : image.dotsPerMeterY() );
+	
+	PixelAccess in( image );
+	auto map = pixelMap( orientation );
+	auto bits = reinterpret_cast<uint32_t*>( out.bits() );
+	int stride = out.bytesPerLine() / sizeof(uint32_t);
+	int width = out.width();
+	
+	if( map.transposed() ){
+		//Each band reads a strip of source columns a cache line at a time, so make them taller
+		parallelRows( out.height(), max( 1, out.bytesPerLine() / 16 ), [&]( int first, int last ){
+				transposeRows( in, bits, stride, width, map, first, last );
+			} );
+	}
+	else{
+		parallelRows( out.height(), out.bytesPerLine(), [&]( int first, int last ){
+				for( int iy=first; iy<last; iy++ )
+					copyRow( in.line( map.sourceY( 0, iy ) ) + map.sourceX( 0, iy ), bits + iy * stride, width, map.xx );
+			} );
+	}
+	
+	return out;
+}
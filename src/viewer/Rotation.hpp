@@ -0,0 +1,35 @@
+/*
+	This file is part of imgviewer.
+
+	imgviewer is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	imgviewer is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with imgviewer.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ROTATION_HPP
+#define ROTATION_HPP
+
+#include <QImage>
+#include <QTransform>
+
+/*
+	Makes a copy of 'image' with 'orientation' applied, which may only
+	rotate by multiples of 90 degrees and mirror, as made by
+	Orientation::transform(). The viewer draws with a transform instead,
+	this is for when the oriented pixels are needed, such as when copying.
+	Rotations are done in cache sized tiles, and images with 32-bit pixels
+	are transposed four by four pixels at a time.
+*/
+QImage orientImage( const QImage& image, const QTransform& orientation );
+
+
+#endif
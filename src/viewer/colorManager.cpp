@@ -16,11 +16,16 @@
 */
 
 #include "colorManager.h"
+#include "ParallelRows.hpp"
 
 #include <lcms2.h>
 #include <QApplication>
-#include <QtConcurrent>
 #include <QImage>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+
+#include <algorithm>
+#include <tuple>
 using namespace std;
 
 #include <qglobal.h>
@@ -98,6 +103,19 @@ using namespace std;
 #endif
 
 
+ColorProfile::ColorProfile( cmsHPROFILE profile ) : profile(profile) {
+	if( profile && cmsMD5computeID( profile ) ){
+		id.resize( 16 );
+		cmsGetHeaderProfileID( profile, reinterpret_cast<cmsUInt8Number*>( id.data() ) );
+	}
+}
+
+bool colorManager::TransformKey::operator<( const TransformKey& other ) const{
+	return tie(       from,       to,       in_format,       out_format,       intent )
+		<  tie( other.from, other.to, other.in_format, other.out_format, other.intent );
+}
+
+
 colorManager::colorManager(){
 #ifdef Q_OS_WIN
 	//Try to grab it from the Windows APIs
@@ -131,21 +149,168 @@ colorManager::colorManager(){
 #endif
 }
 
-void colorManager::doTransform( QImage& img, const ColorProfile& in, unsigned monitor ) const{
-	//Fallback to sRGB if there is no input profile
-	auto& from = in ? in : p_srgb;
+/** Opens an embedded profile, the same profile is returned for identical data */
+shared_ptr<const ColorProfile> colorManager::profileFromMem( const void* data, unsigned len ) const{
+	auto raw = QByteArray::fromRawData( static_cast<const char*>( data ), len );
+	auto hash = QCryptographicHash::hash( raw, QCryptographicHash::Md5 );
 	
+	QMutexLocker locker( &mutex );
+	auto& cached = profiles[hash];
+	if( auto profile = cached.lock() )
+		return profile;
+	
+	auto opened = ColorProfile::fromMem( data, len );
+	if( !opened )
+		return {};
+	auto profile = make_shared<const ColorProfile>( std::move(opened) );
+	cached = profile;
+	
+	//Forget profiles no images are using anymore
+	for( auto it = profiles.begin(); it != profiles.end(); )
+		it = it->second.expired() ? profiles.erase( it ) : next( it );
+	
+	return profile;
+}
+
+/** Removes the least recently used entry if the cache is full */
+template<typename Cache>
+static void makeRoom( Cache& cache, unsigned max_size ){
+	if( cache.size() >= max_size ){
+		auto oldest = min_element( cache.begin(), cache.end()
+			,	[]( const auto& a, const auto& b ){ return a.second.last_used < b.second.last_used; }
+			);
+		cache.erase( oldest );
+	}
+}
+
+shared_ptr<const ColorTransform> colorManager::getTransform( const ColorProfile& from, const ColorProfile& to
+	,	unsigned in_format, unsigned out_format, unsigned intent ) const{
+	//Profiles without an id can't be told apart, so don't cache those
+	if( from.identity().isEmpty() || to.identity().isEmpty() )
+		return make_shared<const ColorTransform>( from.transformTo( to, in_format, out_format, intent ) );
+	
+	TransformKey key{ from.identity(), to.identity(), in_format, out_format, intent };
+	QMutexLocker locker( &mutex );
+	auto it = transforms.find( key );
+	if( it != transforms.end() ){
+		it->second.last_used = ++transform_uses;
+		return it->second.transform;
+	}
+	
+	makeRoom( transforms, max_transforms );
+	
+	//Created while locked, so several threads wanting the same transform only creates it once
+	auto transform = make_shared<const ColorTransform>( from.transformTo( to, in_format, out_format, intent ) );
+	transforms[key] = { transform, ++transform_uses };
+	return transform;
+}
+
+static shared_ptr<const ColorLut> createLut( const ColorProfile& from, const ColorProfile& to, unsigned intent, unsigned size ){
+	//Sample in floating point, so the grid itself doesn't add rounding errors
+	auto transform = from.transformTo( to, TYPE_RGB_FLT, TYPE_RGB_FLT, intent );
+	if( !transform )
+		return make_shared<const ColorLut>();
+	
+	return make_shared<const ColorLut>( [&]( const float* in, float* out, unsigned amount ){
+			transform.execute( in, out, amount );
+		}, size );
+}
+
+shared_ptr<const ColorLut> colorManager::getLut( const ColorProfile& from, const ColorProfile& to
+	,	unsigned intent, unsigned size ) const{
+	if( from.identity().isEmpty() || to.identity().isEmpty() )
+		return createLut( from, to, intent, size );
+	
+	TransformKey key{ from.identity(), to.identity(), TYPE_BGRA_8, size, intent };
+	QMutexLocker locker( &mutex );
+	auto it = luts.find( key );
+	if( it != luts.end() ){
+		it->second.last_used = ++transform_uses;
+		return it->second.lut;
+	}
+	
+	makeRoom( luts, max_transforms );
+	
+	auto lut = createLut( from, to, intent, size );
+	luts[key] = { lut, ++transform_uses };
+	return lut;
+}
+
+const ColorProfile& colorManager::monitorProfile( unsigned monitor ) const{
 	//Fallback to sRGB if there is no profile for the requested monitor
 	auto has_monitor_profile = monitor < monitors.size() && monitors[monitor];
-	auto& output = has_monitor_profile ? monitors[monitor] : p_srgb;
+	return has_monitor_profile ? monitors[monitor] : p_srgb;
+}
+
+void colorManager::doTransform( QImage& img, const ColorProfile* in, unsigned monitor, unsigned lut_size ) const{
+	//Fallback to sRGB if there is no input profile
+	auto& from = ( in && *in ) ? *in : p_srgb;
+	auto& output = monitorProfile( monitor );
 	
-	//Create the transform
-	//TODO: BRRA_8 is not gurantied!
-	//TODO: is perceptual intent what we want? Would there be any need to allow configuation here?
-	auto transform = from.transformTo( output, TYPE_BGRA_8, TYPE_BGRA_8, INTENT_PERCEPTUAL );
-	if( !transform )
+	//Nothing to do when the profiles match, which also avoids detaching the image
+	if( from.isEquivalent( output ) ){
+		identity_count++;
 		return;
+	}
+	transform_count++;
+	
+	//Get the transform
+	//TODO: is perceptual intent what we want? Would there be any need to allow configuation here?
+	normalizeFormat( img );
+	if( lut_size > 0 ){
+		auto lut = getLut( from, output, INTENT_PERCEPTUAL, lut_size );
+		if( *lut ){
+			applyTransform( img, *lut );
+			return;
+		}
+	}
+	
+	//Older lcms versions can't handle premultiplied alpha, so undo it while transforming
+	auto format = pixelFormat( img );
+	bool unpremultiply = format == 0;
+	if( unpremultiply ){
+		img = img.convertToFormat( QImage::Format_ARGB32 );
+		format = pixelFormat( img );
+	}
+	
+	auto transform = getTransform( from, output, format, format, INTENT_PERCEPTUAL );
+	if( *transform )
+		applyTransform( img, *transform );
+	
+	if( unpremultiply )
+		img = img.convertToFormat( QImage::Format_ARGB32_Premultiplied );
+}
+
+void colorManager::normalizeFormat( QImage& img ){
+	switch( img.format() ){
+		case QImage::Format_Indexed8:
+		case QImage::Format_RGB32:
+		case QImage::Format_ARGB32:
+		case QImage::Format_ARGB32_Premultiplied:
+			return;
 		
+		default: img = img.convertToFormat( img.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32 );
+	}
+}
+
+unsigned colorManager::pixelFormat( const QImage& img ){
+	switch( img.format() ){
+		case QImage::Format_ARGB32_Premultiplied:
+#ifdef TYPE_BGRA_8_PREMUL
+			return TYPE_BGRA_8_PREMUL;
+#else
+			return 0; //Requires lcms 2.13
+#endif
+
+		//Color tables of indexed images are not premultiplied either
+		//TODO: BRRA_8 is not gurantied!
+		default: return TYPE_BGRA_8;
+	}
+}
+
+/** Runs 'transform.execute()' on all pixels of the image, for both ColorTransform and ColorLut */
+template<typename Transform>
+static void transformPixels( QImage& img, const Transform& transform ){
 	//For indexed images, we only need to transform the color table
 	if( img.format() == QImage::Format_Indexed8 ){
 		auto colors = img.colorTable();
@@ -155,15 +320,39 @@ void colorManager::doTransform( QImage& img, const ColorProfile& in, unsigned mo
 	}
 	
 	//Make sure the image is in a format we support
-	if( img.format() != QImage::Format_RGB32 && img.format() != QImage::Format_ARGB32 )
+	if( img.format() != QImage::Format_RGB32 && img.format() != QImage::Format_ARGB32 && img.format() != QImage::Format_ARGB32_Premultiplied )
 		img = img.convertToFormat( QImage::Format_ARGB32 );
 	
-	//Convert
-	vector<void*> lines;
-	for( int i=0; i < img.height(); i++ )
-		lines.push_back( static_cast<void*>(img.scanLine( i )) );
-	QtConcurrent::blockingMap( lines.begin(), lines.end()
-		,	[&]( void* line ){ transform.execute( line, line, img.width() ); }
-		);
+	//Detach before starting any threads
+	auto bits = img.bits();
+	auto bytes_per_line = img.bytesPerLine();
+	int width = img.width();
+	bool padded = bytes_per_line != width * 4;
+	parallelRows( img.height(), bytes_per_line, [&,bits,bytes_per_line,width,padded]( int first, int last ){
+			if( padded )
+				for( int iy=first; iy<last; iy++ )
+					transform.execute( bits + iy*bytes_per_line, bits + iy*bytes_per_line, width );
+			else{
+				//Do the entire band in one go
+				auto band = bits + first * bytes_per_line;
+				transform.execute( band, band, width * (last-first) );
+			}
+		} );
 }
 
+void colorManager::applyTransform( QImage& img, const ColorTransform& transform )
+	{ transformPixels( img, transform ); }
+
+void colorManager::applyTransform( QImage& img, const ColorLut& lut ){
+	//Adapter so transformPixels() runs the premultiplied version
+	struct PremultipliedLut{
+		const ColorLut& lut;
+		void execute( const void* in, void* out, unsigned pixels ) const
+			{ lut.executePremultiplied( in, out, pixels ); }
+	};
+	
+	if( img.format() == QImage::Format_ARGB32_Premultiplied )
+		transformPixels( img, PremultipliedLut{ lut } );
+	else
+		transformPixels( img, lut );
+}
@@ -18,8 +18,14 @@
 #ifndef COLOR_MANAGER_H
 #define COLOR_MANAGER_H
 
+#include "ColorLut.hpp"
+
 #include <lcms2.h>
 #include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <atomic>
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -40,31 +46,47 @@ class ColorTransform{
 		~ColorTransform(){ if(transform) cmsDeleteTransform( transform ); }
 		operator bool() const{ return transform; }
 		
-		void execute( const void* input_buffer, void* output_buffer, unsigned size )
+		void execute( const void* input_buffer, void* output_buffer, unsigned size ) const
 			{ cmsDoTransform( transform, input_buffer, output_buffer, size ); }
 };
 
 class ColorProfile{
 	private:
 		cmsHPROFILE profile{ nullptr };
-		ColorProfile( cmsHPROFILE profile ) : profile(profile) { }
+		QByteArray id; //MD5 profile ID, equal profiles have the same id
+		bool builtin_srgb{ false };
+		ColorProfile( cmsHPROFILE profile );
 		
 	public:
 		ColorProfile() { }
 		ColorProfile( const ColorProfile& copy ) = delete;
 		ColorProfile( ColorProfile&& other ){
 			profile = other.profile;
+			id = other.id;
+			builtin_srgb = other.builtin_srgb;
 			other.profile = nullptr;
+			other.id = {};
 		}
 		ColorProfile& operator=( ColorProfile&& other ){
 			cmsCloseProfile( profile );
 			profile = other.profile;
+			id = other.id;
+			builtin_srgb = other.builtin_srgb;
 			other.profile = nullptr;
+			other.id = {};
 			return *this;
 		}
 		~ColorProfile(){ cmsCloseProfile( profile ); }
 		
 		operator bool() const{ return profile; }
+		const QByteArray& identity() const{ return id; }
+		
+		/** @return true if converting between the two profiles would not change anything */
+		bool isEquivalent( const ColorProfile& other ) const{
+			return this == &other
+				||	( builtin_srgb && other.builtin_srgb )
+				||	( !id.isEmpty() && id == other.id );
+		}
 		
 		static ColorProfile fromMem( const void* data, unsigned len )
 			{ return { cmsOpenProfileFromMem( data, len ) }; }
@@ -72,7 +94,11 @@ class ColorProfile{
 		static ColorProfile fromFile( const char* path, const char* options )
 			{ return { cmsOpenProfileFromFile( path, options ) }; }
 		
-		static ColorProfile sRgb(){ return { cmsCreate_sRGBProfile() }; }
+		static ColorProfile sRgb(){
+			ColorProfile srgb{ cmsCreate_sRGBProfile() };
+			srgb.builtin_srgb = true;
+			return srgb;
+		}
 		
 		ColorTransform transformTo( const ColorProfile& to, unsigned in_format, unsigned out_format, unsigned intent, unsigned flags=0 ) const
 			{ return ColorTransform( cmsCreateTransform( profile, in_format, to.profile, out_format, intent, flags ) ); }
@@ -84,11 +110,61 @@ class colorManager{
 		
 		ColorProfile p_srgb{ ColorProfile::sRgb() };
 		
+	private:
+		//Transforms are expensive to create, so reuse them for all images with the same profile
+		struct TransformKey{
+			QByteArray from;
+			QByteArray to;
+			unsigned in_format;
+			unsigned out_format;
+			unsigned intent;
+			
+			bool operator<( const TransformKey& other ) const;
+		};
+		struct CachedTransform{
+			std::shared_ptr<const ColorTransform> transform;
+			unsigned long last_used;
+		};
+		struct CachedLut{
+			std::shared_ptr<const ColorLut> lut;
+			unsigned long last_used;
+		};
+		static const unsigned max_transforms = 16;
+		
+		mutable QMutex mutex;
+		mutable std::map<TransformKey,CachedTransform> transforms;
+		mutable std::map<TransformKey,CachedLut> luts; //out_format is the grid size
+		mutable std::map<QByteArray,std::weak_ptr<const ColorProfile>> profiles; //Keyed by a hash of the profile data
+		mutable unsigned long transform_uses{ 0 };
+		
+		mutable std::atomic<unsigned long> identity_count{ 0 };
+		mutable std::atomic<unsigned long> transform_count{ 0 };
+		
+		const ColorProfile& monitorProfile( unsigned monitor ) const;
 		
 	public:
 		colorManager();
 		
-		void doTransform( class QImage& img, const ColorProfile& in, unsigned monitor ) const;
+		std::shared_ptr<const ColorProfile> profileFromMem( const void* data, unsigned len ) const;
+		std::shared_ptr<const ColorTransform> getTransform( const ColorProfile& from, const ColorProfile& to
+			,	unsigned in_format, unsigned out_format, unsigned intent ) const;
+		std::shared_ptr<const ColorLut> getLut( const ColorProfile& from, const ColorProfile& to
+			,	unsigned intent, unsigned size ) const;
+		
+		/** Transforms to the monitor profile, a 'lut_size' above 0 uses a ColorLut of that size instead of lcms */
+		void doTransform( class QImage& img, const ColorProfile* in, unsigned monitor, unsigned lut_size=0 ) const;
+		
+		/** Converts to a format the transforms can be applied to, keeping premultiplied alpha */
+		static void normalizeFormat( class QImage& img );
+		/** @return The lcms format for the pixels of a normalized image, or 0 if lcms can't handle it */
+		static unsigned pixelFormat( const class QImage& img );
+		/** 'transform' must have been created with pixelFormat(), a ColorLut handles any normalized image */
+		static void applyTransform( class QImage& img, const ColorTransform& transform );
+		static void applyTransform( class QImage& img, const ColorLut& lut );
+		
+		//Amount of images skipped because the profiles matched, and the amount actually transformed
+		unsigned long identityCount() const{ return identity_count; }
+		unsigned long transformCount() const{ return transform_count; }
 };
 
 
@@ -24,6 +24,9 @@
 #include <QImageReader>
 #include <QPainter>
 #include <QTime>
+#include <QMutexLocker>
+
+#include <algorithm>
 
 colorManager* imageCache::manager = nullptr;
 
@@ -34,16 +37,25 @@ void imageCache::init(){
 
 void imageCache::reset(){
 	profile = {};
-	frames.clear();
-	frame_delays.clear();
+	{	QMutexLocker locker( &source_mutex );
+		source.reset();
+		streamed = false;
+	}
+	{	QMutexLocker locker( &mutex );
+		frames.clear();
+		frame_delays.clear();
+		frame_changes.clear();
+		display_frames.clear();
+	}
 	error_msgs.clear();
 	frames_loaded = 0;
+	wanted_frame = -1;
 	memory_size = 0;
 	current_status = EMPTY;
 	emit info_loaded();
 }
 
-void imageCache::set_profile( ColorProfile&& profile ){
+void imageCache::set_profile( std::shared_ptr<const ColorProfile> profile ){
 	this->profile = std::move(profile);
 	emit info_loaded();
 }
@@ -56,21 +68,208 @@ void imageCache::set_info( unsigned total_frames, bool is_animated, int loops ){
 	emit info_loaded();
 }
 
-void imageCache::add_frame( QImage frame, unsigned delay ){
-	frames_loaded++;
-	frames.push_back( frame );
-	frame_delays.push_back( delay );
+void imageCache::add_frame( QImage frame, unsigned delay, QRect changed ){
+	set_frame( frames_loaded, frame, delay, changed );
+}
+
+void imageCache::set_frame( unsigned idx, QImage frame, unsigned delay, QRect changed ){
+	{	QMutexLocker locker( &mutex );
+		if( frames.size() <= idx ){
+			frames.resize( idx+1 );
+			frame_delays.resize( idx+1, 0 );
+			frame_changes.resize( idx+1 );
+		}
+		frames[idx] = frame;
+		frame_delays[idx] = delay;
+		frame_changes[idx] = changed;
+		
+		while( frames_loaded < (int)frames.size() && !frames[frames_loaded].isNull() )
+			frames_loaded++;
+	}
 	current_status = FRAMES_READY;
 	
-	if( frame_amount < frames_loaded ){
-		frame_amount = frames_loaded;
+	if( frame_amount < (int)idx+1 ){
+		frame_amount = idx+1;
 		emit info_loaded();
 	}
-	emit frame_loaded( frames_loaded-1 );
+	emit frame_loaded( idx );
 }
 
 void imageCache::set_fully_loaded(){
 	current_status = LOADED;
 }
 
+void imageCache::drop_frame( unsigned idx ){
+	QMutexLocker locker( &mutex );
+	if( idx >= frames.size() )
+		return;
+	
+	//The delay is kept, it is needed before the frame is decoded again
+	frames[idx] = QImage();
+	for( auto& monitor : display_frames )
+		if( idx < monitor.second.size() )
+			monitor.second[idx] = {};
+	frames_loaded = std::min( frames_loaded, (int)idx );
+}
+
+void imageCache::set_source( std::unique_ptr<FrameSource> source, int next, qint64 budget ){
+	QMutexLocker locker( &source_mutex );
+	auto first = frame( 0 );
+	qint64 frame_bytes = std::max( first.bytesPerLine() * qint64( first.height() ), qint64( 1 ) );
+	source_window = std::max( 2, (int)std::min( budget / frame_bytes, qint64( frame_amount ) ) );
+	source_next = next;
+	this->source = std::move( source );
+	streamed = true;
+}
+
+void imageCache::set_playhead( int idx ){
+	int amount = frame_amount;
+	if( !streamed || amount < 1 )
+		return;
+	playhead = idx % amount;
+	emit frames_wanted();
+}
+
+void imageCache::load_ahead(){
+	//Only one thread decodes, calling it while it does makes it go again
+	more_wanted = true;
+	while( more_wanted && source_mutex.tryLock() ){
+		while( more_wanted.exchange( false ) )
+			if( source )
+				fill_window();
+		source_mutex.unlock();
+	}
+}
+
+void imageCache::fill_window(){
+	int amount = frame_amount;
+	int current = playhead;
+	auto ahead = [&]( int idx ){ return ( idx - current + amount ) % amount; };
+	
+	//Forget the frames which have been shown, to make room for the ones about to be
+	for( int i=0; i<amount; i++ )
+		if( ahead( i ) >= source_window && has_frame( i ) )
+			drop_frame( i );
+	
+	for( int i=0; i<source_window; i++ ){
+		int idx = ( current + i ) % amount;
+		if( has_frame( idx ) )
+			continue;
+		
+		//Looping, it can only decode forwards
+		if( idx < source_next ){
+			if( !source->restart() )
+				return;
+			source_next = 0;
+		}
+		
+		//Frames before it are decoded to get to it, but only kept if they are to be shown soon
+		QImage frame;
+		int delay;
+		while( source_next <= idx ){
+			if( !source->read( frame, delay ) )
+				return;
+			if( ahead( source_next ) < source_window && !has_frame( source_next ) )
+				set_frame( source_next, frame, delay );
+			source_next++;
+		}
+		
+		//Start over from where it is shown now
+		if( playhead != current )
+			return;
+	}
+}
+
+bool imageCache::has_frame( int idx ) const{
+	QMutexLocker locker( &mutex );
+	return idx >= 0 && idx < (int)frames.size() && !frames[idx].isNull();
+}
 
+QImage imageCache::frame( unsigned int idx ) const{
+	QMutexLocker locker( &mutex );
+	return idx < frames.size() ? frames[ idx ] : QImage();
+}
+
+int imageCache::frame_delay( unsigned int idx ) const{
+	QMutexLocker locker( &mutex );
+	return idx < frame_delays.size() ? frame_delays[ idx ] : 0;
+}
+
+QRect imageCache::frame_changed( unsigned int idx ) const{
+	QMutexLocker locker( &mutex );
+	if( idx >= frames.size() || frames[idx].isNull() )
+		return {};
+	//Everything changes if unknown
+	return frame_changes[idx].isNull() || idx == 0 ? frames[idx].rect() : frame_changes[idx];
+}
+
+bool imageCache::set_display_monitor( int monitor ){
+	QMutexLocker locker( &mutex );
+	if( monitor == display_monitor )
+		return false;
+	
+	//Forget the oldest monitor, but keep the one we are moving away from
+	if( !display_frames.count( monitor ) && display_frames.size() >= max_display_monitors )
+		for( auto it = display_frames.begin(); it != display_frames.end(); ++it )
+			if( it->first != display_monitor ){
+				display_frames.erase( it );
+				break;
+			}
+	display_monitor = monitor;
+	
+	//Frames might still be here from the last time we were on this monitor
+	auto& prepared = display_frames[monitor];
+	if( prepared.size() < frames.size() )
+		return true;
+	return std::any_of( prepared.begin(), prepared.begin() + frames.size(), []( const DisplayFrame& frame ){ return frame.image.isNull(); } );
+}
+
+int imageCache::get_display_monitor() const{
+	QMutexLocker locker( &mutex );
+	return display_monitor;
+}
+
+void imageCache::set_display_frame( unsigned idx, int monitor, QImage frame ){
+	{	QMutexLocker locker( &mutex );
+		//The monitor might have been dropped while this frame was prepared
+		auto it = display_frames.find( monitor );
+		if( it == display_frames.end() )
+			return;
+		
+		auto& frames = it->second;
+		if( frames.size() <= idx )
+			frames.resize( idx+1 );
+		frames[idx] = { frame, {} };
+	}
+	emit frame_prepared( idx );
+}
+
+void imageCache::set_display_mipmaps( unsigned idx, int monitor, const QImage& frame, MipChain mipmaps ){
+	{	QMutexLocker locker( &mutex );
+		auto it = display_frames.find( monitor );
+		if( it == display_frames.end() || idx >= it->second.size() )
+			return;
+		
+		auto& prepared = it->second[idx];
+		if( prepared.image.cacheKey() != frame.cacheKey() )
+			return;
+		prepared.mipmaps = std::move( mipmaps );
+	}
+	emit frame_prepared( idx );
+}
+
+QImage imageCache::display_frame( unsigned idx, int monitor ) const{
+	QMutexLocker locker( &mutex );
+	auto it = display_frames.find( monitor );
+	if( it == display_frames.end() || idx >= it->second.size() )
+		return {};
+	return it->second[idx].image;
+}
+
+MipChain imageCache::display_mipmaps( unsigned idx, int monitor ) const{
+	QMutexLocker locker( &mutex );
+	auto it = display_frames.find( monitor );
+	if( it == display_frames.end() || idx >= it->second.size() )
+		return {};
+	return it->second[idx].mipmaps;
+}
@@ -19,12 +19,19 @@
 #define IMAGECACHE_H
 
 #include "colorManager.h"
+#include "FrameSource.hpp"
 #include "Orientation.hpp"
+#include "MipChain.hpp"
 
 #include <QObject>
 #include <QImage>
+#include <QMutex>
+#include <QRect>
 #include <QStringList>
 #include <QUrl>
+#include <atomic>
+#include <map>
+#include <memory>
 #include <vector>
 
 class colorManager;
@@ -38,20 +45,45 @@ class imageCache: public QObject{
 		
 	private:
 	//Variables containing info about the image(s)
-		ColorProfile profile;
+		std::shared_ptr<const ColorProfile> profile; //Shared with other images using the same profile
 		
-		int frame_amount{ 0 };
-		std::vector<QImage> frames;
+		std::atomic<int> frame_amount{ 0 }; //Read by the thread decoding streamed animations
+		std::vector<QImage> frames; //Null until loaded, readers which can seek might load them out of order
 		int frames_loaded{ 0 };
+		std::atomic<int> wanted_frame{ -1 };
+		
+		//Animations too large to keep are decoded while they are shown, keeping the frames about to be shown
+		std::unique_ptr<FrameSource> source;
+		std::atomic<bool> streamed{ false }; //If 'source' is set, which is only accessed with 'source_mutex' held
+		int source_next{ 0 }; //The frame the source decodes next
+		int source_window{ 0 }; //The amount of frames kept from the playhead
+		std::atomic<int> playhead{ 0 };
+		std::atomic<bool> more_wanted{ false };
+		QMutex source_mutex;
+		void fill_window();
+		void drop_frame( unsigned idx );
 		
 		bool animate{ false };
 		std::vector<int> frame_delays;
+		std::vector<QRect> frame_changes; //Null if unknown
 		int loop_amount{ 0 };	//Amount of times the loop should continue looping
 		
 		Orientation orientation;
 		
 		long memory_size{ 0 };
 		
+		//Frames prepared for display by the loading pipeline, for the current and the previous monitor.
+		//They are not oriented yet, the viewer does that while drawing
+		static const unsigned max_display_monitors = 2;
+		struct DisplayFrame{
+			QImage image;
+			MipChain mipmaps; //Made after the image, so it might be empty for a while
+		};
+		int display_monitor{ -1 };
+		std::map<int,std::vector<DisplayFrame>> display_frames; //Keyed by monitor
+		
+		mutable QMutex mutex; //Frames are added and prepared from worker threads
+		
 	//Info about loading
 	public:
 		enum status{
@@ -70,7 +102,12 @@ class imageCache: public QObject{
 			emit info_loaded();
 		}
 		status get_status() const{ return current_status; } //Current status
-		int loaded() const{ return frames_loaded; }	//Amount of currently loaded frames
+		int loaded() const{ return frames_loaded; }	//Amount of frames loaded without any missing before them
+		bool has_frame( int idx ) const;
+		
+		//The frame the viewer is waiting on, readers which can seek should load it first
+		void request_frame( int idx ){ wanted_frame = idx; }
+		int requested_frame() const{ return wanted_frame; }
 		
 		void reset();
 		
@@ -88,12 +125,28 @@ class imageCache: public QObject{
 			set_fully_loaded();
 		}
 		
-		void set_profile( ColorProfile&& profile );
+		void set_profile( std::shared_ptr<const ColorProfile> profile );
 		void set_info( unsigned total_frames, bool is_animated=false, int loops=0 );
 		void set_orientation( Orientation orientation ){ this->orientation = orientation; }
-		void add_frame( QImage frame, unsigned delay );
+		void add_frame( QImage frame, unsigned delay, QRect changed = {} ); //'changed' is the area which differs from the previous frame
+		void set_frame( unsigned idx, QImage frame, unsigned delay, QRect changed = {} ); //As add_frame(), but in any order
 		void set_fully_loaded();
 		
+		//Keep decoding frames from 'source' when needed, 'next' frames have been added already.
+		//Frames further ahead than 'budget' allows are discarded, and decoded again when they are needed
+		void set_source( std::unique_ptr<FrameSource> source, int next, qint64 budget );
+		bool is_streamed() const{ return streamed; }
+		void set_playhead( int idx ); //The frame being shown, emits frames_wanted() if frames should be decoded
+		void load_ahead(); //Decodes the frames after the playhead, call it in a worker thread
+		
+		//Frames prepared for display, frames for the previous display monitor are kept as well
+		bool set_display_monitor( int monitor ); //Returns true if frames needs to be prepared for it
+		int get_display_monitor() const;
+		void set_display_frame( unsigned idx, int monitor, QImage frame );
+		void set_display_mipmaps( unsigned idx, int monitor, const QImage& frame, MipChain mipmaps ); //Ignored if 'frame' was replaced
+		QImage display_frame( unsigned idx, int monitor ) const;
+		MipChain display_mipmaps( unsigned idx, int monitor ) const;
+		
 		long get_memory_size() const{ return memory_size; }	//Notice, this is a rough number, not accurate!
 		
 		//Animation info
@@ -102,17 +155,20 @@ class imageCache: public QObject{
 		
 		//Meta data
 		Orientation get_orientation() const{ return orientation; }
-		const ColorProfile& get_profile() const{ return profile; }
+		const ColorProfile* get_profile() const{ return profile.get(); }
 		colorManager* get_manager() const{ return manager; }
 		
 		//Frame info
 		int frame_count() const{ return frame_amount; }
-		QImage frame( unsigned int idx ) const{ return idx < frames.size() ? frames[ idx ] : QImage(); }
-		int frame_delay( unsigned int idx ) const{ return idx < frames.size() ? frame_delays[ idx ] : 0; } //How long a frame should be shown
+		QImage frame( unsigned int idx ) const;
+		int frame_delay( unsigned int idx ) const; //How long a frame should be shown
+		QRect frame_changed( unsigned int idx ) const; //The area which differs from the previous frame
 	
 	signals:
 		void info_loaded();
 		void frame_loaded( unsigned int idx );
+		void frame_prepared( unsigned int idx );
+		void frames_wanted();
 };
 
 
@@ -18,13 +18,14 @@
 #include "imageViewer.h"
 #include "imageCache.h"
 #include "qrect_extras.h"
-#include "colorManager.h"
+#include "Rotation.hpp"
 
 using namespace std;
 
 #include <QPoint>
 #include <QSize>
 #include <QRect>
+#include <QRegion>
 
 #include <QPainter>
 #include <QImage>
@@ -35,12 +36,15 @@ using namespace std;
 #include <QColor>
 
 #include <QTimer>
+#include <QtConcurrent>
 
 #include <QMouseEvent>
+#include <QPaintEvent>
 #include <QWheelEvent>
 
-#include <QApplication>
-#include <QDesktopWidget>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QWindow>
 
 #include <QDrag>
 #include <QMimeData>
@@ -49,7 +53,11 @@ using namespace std;
 #include <algorithm>
 
 
-imageViewer::imageViewer( const QSettings& settings, QWidget* parent ): QWidget( parent ), settings( settings ){
+imageViewer::imageViewer( const QSettings& settings, QWidget* parent )
+	:	QWidget( parent )
+	,	ring( settings.value( "viewer/animation-budget", 128 ).toLongLong() * 1024 * 1024 )
+	,	settings( settings )
+	{
 	//User settings
 	auto_aspect_ratio   = settings.value( "viewer/aspect_ratio",   true  ).toBool();
 	auto_downscale_only = settings.value( "viewer/downscale",      true  ).toBool();
@@ -58,6 +66,12 @@ imageViewer::imageViewer( const QSettings& settings, QWidget* parent ): QWidget(
 	restrict_viewpoint  = settings.value( "viewer/restrict",       true  ).toBool();
 	initial_resize      = settings.value( "viewer/initial_resize", true  ).toBool();
 	keep_resize         = settings.value( "viewer/keep_resize",    false ).toBool();
+	downscale_filter    = settings.value( "viewer/downscaling", "lanczos" ).toString() == "area"
+		?	ResampleFilter::AREA : ResampleFilter::LANCZOS3;
+	kinetic_panning     = settings.value( "viewer/kinetic-panning", true ).toBool();
+	log_fps             = settings.value( "viewer/log-fps", false ).toBool();
+	pause_hidden        = settings.value( "viewer/pause-hidden", true ).toBool();
+	log_cpu             = settings.value( "viewer/log-cpu", false ).toBool();
 	
 	button_rleft   = translate_button( "mouse/rocker-left",  'L' );
 	button_rright  = translate_button( "mouse/rocker-right", 'R' );
@@ -68,54 +82,173 @@ imageViewer::imageViewer( const QSettings& settings, QWidget* parent ): QWidget(
 	
 	time = new QTimer( this );
 	time->setSingleShot( true );
-	connect( time, SIGNAL( timeout() ), this, SLOT( next_frame() ) );
+	time->setTimerType( Qt::PreciseTimer );
+	connect( time, SIGNAL( timeout() ), this, SLOT( animation_tick() ) );
 	
+	refine_timer = new QTimer( this );
+	refine_timer->setSingleShot( true );
+	refine_timer->setInterval( settings.value( "viewer/refine-delay", 100 ).toInt() );
+	connect( refine_timer, SIGNAL( timeout() ), this, SLOT( refine() ) );
+	
+	refine_watcher = new QFutureWatcher<std::vector<DisplayTiles::Tile>>( this );
+	connect( refine_watcher, SIGNAL( finished() ), this, SLOT( refine_finished() ) );
+	
+	ring_watcher = new QFutureWatcher<std::vector<FrameRing::Frame>>( this );
+	connect( ring_watcher, SIGNAL( finished() ), this, SLOT( ring_filled() ) );
+	
+	kinetic_timer = new QTimer( this );
+	kinetic_timer->setInterval( 16 );
+	connect( kinetic_timer, SIGNAL( timeout() ), this, SLOT( kinetic_step() ) );
+	
+	//Everything is drawn by paintEvent, which allows scroll() to move the contents
+	setAttribute( Qt::WA_OpaquePaintEvent );
 	setContextMenuPolicy( Qt::PreventContextMenu );
 }
 
-void imageViewer::updateOrientation( Orientation wanted, Orientation current ){
-	auto orientation = current.difference( wanted ).normalized();
-	if( orientation.rotation != 0 ){
-		QTransform transform;
-		transform.rotate( orientation.rotation * 90 );
-		converted = converted.transformed( transform );
-	}
-	converted = converted.mirrored( orientation.flip_hor, orientation.flip_ver );
-}
-
 void imageViewer::rotate( int8_t amount ){
-	auto transform = orientation.rotate( amount );
-	updateOrientation( transform, orientation );
-	orientation = transform;
+	orientation = orientation.rotate( amount );
 	zoom.change_content(frameSize(), true);
 	updateView();
 	update();
 }
 
 void imageViewer::mirror( bool hor, bool ver ){
-	auto transform = orientation.mirror( hor, ver );
-	updateOrientation( transform, orientation );
-	orientation = transform;
+	orientation = orientation.mirror( hor, ver );
 	update();
 }
 
+/* @return Maps a frame of 'frame_size' to how it is shown, first in the orientation of the file and then the one chosen by the user */
+QTransform imageViewer::orient_transform( QSize frame_size ) const{
+	auto file = image_cache ? image_cache->get_orientation() : Orientation();
+	return file.transform( frame_size ) * orientation.transform( file.finalSize( frame_size ) );
+}
+
+/* @return The size a frame has before it is oriented */
+QSize imageViewer::unoriented( QSize oriented ) const{
+	auto file = image_cache ? image_cache->get_orientation() : Orientation();
+	return orientation.add( file ).finalSize( oriented );
+}
+
+/* @return The current frame, as it is to be copied */
 QImage imageViewer::get_frame(){
-	if( !image_cache || current_frame >= image_cache->loaded() )
+	auto frame = converted_frame();
+	return orientImage( frame, orient_transform( frame.size() ) );
+}
+
+QImage imageViewer::converted_frame(){
+	if( !image_cache || !image_cache->has_frame( current_frame ) )
 		return {};
 	
-	int current_monitor = QApplication::desktop()->screenNumber( this );
-	if( converted_monitor != current_monitor ){
-		//Cache invalid, refresh
-		converted = image_cache->frame( current_frame );
-		
-		//Transform colors to current monitor profile
-		image_cache->get_manager()->doTransform( converted, image_cache->get_profile(), current_monitor );
-		converted_monitor = current_monitor;
-		
-		updateOrientation( orientation.add(image_cache->get_orientation()), {} );
+	auto it = converted.find( monitor );
+	if( it == converted.end() ){
+		//Forget a monitor we are no longer on, but keep the one we just left
+		if( converted.size() >= max_converted )
+			for( auto old = converted.begin(); old != converted.end(); ++old )
+				if( old->first != previous_monitor ){
+					converted.erase( old );
+					break;
+				}
+		it = converted.emplace( monitor, ConvertedFrame() ).first;
 	}
 	
-	return converted;
+	auto& cached = it->second;
+	if( cached.frame != current_frame ){
+		//Cache invalid, check if the wanted frame has been prepared yet
+		auto prepared = image_cache->display_frame( current_frame, monitor );
+		if( !prepared.isNull() ){
+			cached.image = prepared;
+			cached.mipmaps = {};
+			cached.frame = current_frame;
+		}
+	}
+	
+	//The mipmaps of large frames are made after the frame itself
+	if( cached.frame == current_frame && cached.mipmaps.empty() && MipChain::wanted( cached.image ) )
+		cached.mipmaps = image_cache->display_mipmaps( current_frame, monitor );
+	
+	if( cached.frame == current_frame ){
+		shown = cached.image;
+		shown_mipmaps = cached.mipmaps;
+		shown_frame = current_frame;
+	}
+	return shown;
+}
+
+/* Follow the screen of the window we are in, which only exists once shown */
+void imageViewer::watch_window(){
+	auto handle = window()->windowHandle();
+	if( !handle || handle == watched_window )
+		return;
+	
+	if( watched_window ){
+		disconnect( watched_window, 0, this, 0 );
+		watched_window->removeEventFilter( this );
+	}
+	watched_window = handle;
+	connect( watched_window, SIGNAL( screenChanged(QScreen*) ), this, SLOT( screen_changed(QScreen*) ) );
+	screen_changed( watched_window->screen() );
+	
+	//Being covered or on another desktop only shows up as expose events
+	connect( watched_window, SIGNAL( visibilityChanged(QWindow::Visibility) ), this, SLOT( window_visibility() ) );
+	watched_window->installEventFilter( this );
+	visibility_clock.start();
+	visibility_cpu = std::clock();
+	window_visibility();
+}
+
+bool imageViewer::eventFilter( QObject* watched, QEvent* event ){
+	if( watched == watched_window && event->type() == QEvent::Expose )
+		window_visibility();
+	return QWidget::eventFilter( watched, event );
+}
+
+void imageViewer::window_visibility(){
+	bool now_hidden = watched_window && ( !watched_window->isExposed() || watched_window->visibility() == QWindow::Minimized );
+	if( now_hidden == hidden )
+		return;
+	hidden = now_hidden;
+	emit visibility_changed( !hidden );
+	
+	if( log_cpu && visibility_clock.isValid() )
+		qDebug( "viewer: %s for %.1f s, using %.2f s of CPU time"
+			,	hidden ? "visible" : "hidden"
+			,	visibility_clock.elapsed() / 1000.0
+			,	double( std::clock() - visibility_cpu ) / CLOCKS_PER_SEC
+			);
+	visibility_clock.start();
+	visibility_cpu = std::clock();
+	
+	if( !pause_hidden )
+		return;
+	
+	if( hidden ){
+		time->stop();
+		refine_timer->stop();
+		stop_kinetic();
+		hidden_since = timeline.isValid() ? timeline.elapsed() : 0;
+	}
+	else{
+		//Continue where it was paused, with what was left of the frame delay
+		if( timeline.isValid() )
+			timeline_paused += timeline.elapsed() - hidden_since;
+		if( continue_animating && image_cache && waiting_on_frame < 0 ){
+			int delay = image_cache->frame_delay( current_frame );
+			if( delay > 0 )
+				time->start( std::max( frame_due + delay - timeline_now(), qint64(0) ) );
+			fill_ring();
+		}
+		update();
+	}
+}
+
+void imageViewer::screen_changed( QScreen* screen ){
+	int current_monitor = QGuiApplication::screens().indexOf( screen );
+	if( monitor != current_monitor ){
+		previous_monitor = monitor;
+		monitor = current_monitor;
+		emit monitor_changed( monitor ); //Frames needs to be prepared for this monitor
+		update();
+	}
 }
 
 QSize imageViewer::frameSize( unsigned index ) const{
@@ -134,15 +267,20 @@ bool imageViewer::can_animate() const{
 void imageViewer::change_frame( int wanted ){
 	if( !image_cache )
 		return;
-	clear_converted();
 	
 	//Cycle backwards
 	if( wanted < 0 )
 		wanted = frame_amount - 1;
 	
-	if( image_cache->loaded() < frame_amount && wanted >= image_cache->loaded() ){
-		//Wait for frame to be available
+	//Animations decoded while shown decode the frames after it
+	image_cache->set_playhead( wanted );
+	
+	//The amount of frames is known for those, so going past the last frame loops
+	bool missing = !image_cache->has_frame( wanted ) && ( wanted < frame_amount || !image_cache->is_streamed() );
+	if( image_cache->loaded() < frame_amount && missing ){
+		//Wait for frame to be available, readers which can seek will load it next
 		waiting_on_frame = wanted;
+		image_cache->request_frame( wanted );
 		return;
 	}
 	
@@ -164,19 +302,137 @@ void imageViewer::change_frame( int wanted ){
 			continue_animating = false;	//Stop looping
 			current_frame--;
 		}
+		
+		if( log_fps && timeline.isValid() && timeline_now() > 0 && frame_due > 0 )
+			qDebug( "animation: %.1f fps shown, %.1f fps wanted, %d frames dropped"
+				,	frames_shown * 1000.0 / timeline_now()
+				,	( frames_shown + frames_dropped ) * 1000.0 / frame_due
+				,	frames_dropped
+				);
+		
+		//The frame looped to might have to be decoded again
+		if( !image_cache->has_frame( current_frame ) ){
+			waiting_on_frame = current_frame;
+			return;
+		}
 	}
 	
 	
 	if( continue_animating ){
 		int delay = image_cache->frame_delay( current_frame );
-		if( delay > 0 )
-			time->start( delay );
+		if( delay > 0 ){
+			//Waiting on loading would make it rush through the frames to catch up, start over instead
+			if( timeline_now() - frame_due > 500 )
+				restart_timeline();
+			frames_shown++;
+			if( !paused() )
+				time->start( std::max( frame_due + delay - timeline_now(), qint64(0) ) );
+		}
+		fill_ring();
 	}
 	
-	update();
+	update_changes();
 	emit image_changed();
 }
 
+/* Repaints what differs from the frame shown last, which is often only a small part of animations */
+void imageViewer::update_changes(){
+	auto frame = image_cache->frame( current_frame ).size();
+	if( shown_frame < 0 || current_frame <= shown_frame || image_cache->frame( shown_frame ).size() != frame ){
+		update();
+		return;
+	}
+	
+	QRect changed;
+	for( int i=shown_frame+1; i<=current_frame; i++ ){
+		//Skipped by seeking, so what changed is unknown
+		if( !image_cache->has_frame( i ) ){
+			update();
+			return;
+		}
+		changed |= image_cache->frame_changed( i );
+	}
+	
+	//Map it to the widget, with room for the scaling spreading the changes out
+	auto size = unoriented( zoom.size() );
+	auto scaling = QTransform::fromScale( size.width() / double(frame.width()), size.height() / double(frame.height()) );
+	int margin = std::ceil( std::max( 3.0, zoom.scale() ) ) + 1;
+	update( ( scaling * display_transform() ).mapRect( QRectF( changed ) ).toAlignedRect().adjusted( -margin, -margin, margin, margin ) );
+}
+
+void imageViewer::restart_timeline(){
+	timeline.start();
+	timeline_paused = 0;
+	hidden_since = 0;
+	frame_due = 0;
+	frames_shown = 0;
+	frames_dropped = 0;
+}
+
+void imageViewer::animation_tick(){
+	//The next frame is due when the current one has been shown for its delay
+	frame_due += image_cache->frame_delay( current_frame );
+	int wanted = current_frame + 1;
+	
+	//Skip frames which already should have been replaced, rather than falling behind.
+	//Frames which are still loading and the last frame before looping are always shown.
+	auto now = timeline_now();
+	while( wanted + 1 < frame_amount && image_cache->has_frame( wanted ) && image_cache->has_frame( wanted + 1 ) ){
+		int delay = image_cache->frame_delay( wanted );
+		if( frame_due + delay > now )
+			break;
+		frame_due += delay;
+		frames_dropped++;
+		wanted++;
+	}
+	
+	change_frame( wanted );
+}
+
+/* Scales the frames about to be shown in the background, while animating zoomed out */
+void imageViewer::fill_ring(){
+	if( !image_cache || !continue_animating || frame_amount < 2 || interacting || paused() || ring_watcher->isRunning() )
+		return;
+	
+	auto wanted = unoriented( zoom.size() );
+	if( shown.isNull() || wanted.width() > shown.width() || wanted.height() > shown.height() || wanted == shown.size() ){
+		ring.clear(); //Frames are drawn directly
+		return;
+	}
+	ring.reset( wanted );
+	
+	//In the order they will be shown, as far as the budget allows and they have been prepared
+	struct Source{ int index; qint64 key; QImage level; };
+	std::vector<Source> sources;
+	int ahead = std::min( ring.capacity(), frame_amount );
+	for( int i=0; i<ahead && sources.size() < 8; i++ ){
+		int index = ( current_frame + i ) % frame_amount;
+		auto frame = image_cache->display_frame( index, monitor );
+		if( frame.isNull() )
+			break;
+		if( ring.get( index, frame ).isNull() )
+			sources.push_back( { index, frame.cacheKey(), image_cache->display_mipmaps( index, monitor ).level( frame, wanted ) } );
+	}
+	if( sources.empty() )
+		return;
+	
+	auto filter = downscale_filter;
+	ring_image = image_cache;
+	ring_watcher->setFuture( QtConcurrent::run( [=](){
+			std::vector<FrameRing::Frame> made;
+			for( auto& source : sources )
+				made.push_back( { source.index, source.key, resample( source.level, wanted, filter ) } );
+			return made;
+		} ) );
+}
+
+void imageViewer::ring_filled(){
+	if( image_cache && ring_image.lock() == image_cache ){
+		ring.add( ring_watcher->result(), current_frame, frame_amount );
+		fill_ring();
+	}
+}
+
 void imageViewer::goto_frame( int index ){
 	time->stop();
 	continue_animating = false;
@@ -189,6 +445,7 @@ void imageViewer::goto_frame( int index ){
 
 void imageViewer::restart_animation(){
 	continue_animating = can_animate();
+	restart_timeline();
 	change_frame( 0 );
 }
 
@@ -201,6 +458,7 @@ bool imageViewer::toogle_animation(){
 		}
 		else{
 			continue_animating = true;
+			restart_timeline();
 			next_frame();
 		}
 	}
@@ -216,6 +474,8 @@ void imageViewer::restrict_view( bool force ){
 
 void imageViewer::change_zoom( double new_level, QPoint keep_on ){
 	auto_scale_on = false;
+	start_interaction();
+	stop_kinetic();
 	
 	if( zoom.change_scale( new_level, keep_on ) ){
 		restrict_view();
@@ -257,11 +517,13 @@ void imageViewer::read_info(){
 	frame_amount = image_cache->frame_count();
 	loop_counter = image_cache->loop_count();
 	continue_animating = image_cache->is_animated();
+	restart_timeline();
 	
 	emit image_info_read();
 }
 void imageViewer::check_frame( unsigned int idx ){
-	if( idx == 0 )
+	//Streamed animations decode frame 0 again when looping, only the first one sets the size
+	if( idx == 0 && !size_initialised )
 		init_size();
 	
 	if( waiting_on_frame <= -1 )
@@ -273,7 +535,14 @@ void imageViewer::check_frame( unsigned int idx ){
 	}
 }
 
+void imageViewer::check_prepared( unsigned int idx ){
+	if( (int)idx == current_frame )
+		update();
+}
+
 void imageViewer::init_size(){
+	size_initialised = true;
+	
 	//TODO: customize
 	if( initial_resize )
 		emit resize_wanted();
@@ -294,18 +563,27 @@ void imageViewer::change_image( std::shared_ptr<imageCache> new_image ){
 		return;
 	
 	time->stop(); //Prevent previous animation to interfere
+	stop_kinetic();
+	
+	if( image_cache )
+		disconnect( image_cache.get(), 0, this, 0 );
 	
 	image_cache = std::move(new_image);
 	waiting_on_frame = -1;
+	size_initialised = false;
 	current_frame = 0;
 	frame_amount = 0;
+	shown = QImage();
+	shown_mipmaps = {};
+	shown_frame = -1;
+	tiles.clear();
+	ring.clear();
 	clear_converted();
 	
 	if( image_cache ){
 		switch( image_cache->get_status() ){
 			case imageCache::INVALID:	break; //Loading failed
 			
-			//TODO: remove those connections again
 			case imageCache::EMPTY:
 					connect( image_cache.get(), SIGNAL( info_loaded() ), this, SLOT( read_info() ) );
 					connect( image_cache.get(), SIGNAL( frame_loaded(unsigned int) ), this, SLOT( check_frame(unsigned int) ) );
@@ -323,6 +601,9 @@ void imageViewer::change_image( std::shared_ptr<imageCache> new_image ){
 				break;
 		}
 		
+		//Frames are prepared in the background, which might finish after loading
+		connect( image_cache.get(), SIGNAL( frame_prepared(unsigned int) ), this, SLOT( check_prepared(unsigned int) ) );
+		
 		if( image_cache->loaded() >= 1 )
 			init_size();
 		else
@@ -342,6 +623,8 @@ void imageViewer::draw_message( QStaticText *text ){
 	int y = ( size().height() - txt_size.height() ) * 0.5;
 	
 	QPainter painter( this );
+	painter.fillRect( rect(), palette().window() );
+	
 	//Prepare drawing
 	painter.setRenderHints( QPainter::Antialiasing, true );
 	painter.setBrush( QBrush( QColor( Qt::gray ) ) );
@@ -354,7 +637,7 @@ void imageViewer::draw_message( QStaticText *text ){
 }
 
 
-void imageViewer::paintEvent( QPaintEvent* ){
+void imageViewer::paintEvent( QPaintEvent* event ){
 	static QStaticText txt_loading( tr( "Loading" ) );
 	static QStaticText txt_no_image( tr( "No image selected" ) );
 	static QStaticText txt_invalid( tr( "Image invalid or broken!" ) );
@@ -372,19 +655,132 @@ void imageViewer::paintEvent( QPaintEvent* ){
 		draw_message( &txt_invalid );
 		return;
 	}
-	if( current_frame >= image_cache->loaded() ){
+	if( !image_cache->has_frame( current_frame ) ){
 		//Image is currently loading
 		draw_message( &txt_loading );
 		return;
 	}
 	
 	
+	auto frame = converted_frame();
+	if( frame.isNull() ){
+		//Frame is still being color managed
+		draw_message( &txt_loading );
+		return;
+	}
+	
 	//Everything went fine, start drawing the image
 	QPainter painter( this );
-	if( zoom.scale() <= 1.5 )
+	
+	//Only the background around the image needs to be cleared, unless it is transparent
+	QRegion background( event->rect() );
+	if( !frame.hasAlphaChannel() )
+		background -= zoom.area();
+	painter.setClipRegion( background );
+	painter.fillRect( event->rect(), palette().window() );
+	painter.setClipping( false );
+	
+	auto transform = display_transform();
+	auto area = scaled_area( event->rect() );
+	
+	//Animations are drawn from the frames scaled ahead of time, once they are there
+	auto ready = ring.get( current_frame, frame );
+	if( !ready.isNull() && ready.size() == unoriented( zoom.size() ) ){
+		painter.setTransform( transform );
+		painter.drawImage( area.topLeft(), ready, area );
+		return;
+	}
+	if( update_tiles( frame, shown_mipmaps, area, scaled_area( rect() ) ) ){
+		painter.setTransform( transform );
+		tiles.draw( painter, area );
+		return;
+	}
+	
+	//Zoomed in, or a preview from the nearest level until refine() is done
+	if( zoom.scale() <= 1.5 && !interacting )
 		painter.setRenderHints( QPainter::SmoothPixmapTransform, true );
+	auto size = unoriented( zoom.size() );
+	auto& source = shown_mipmaps.level( frame, size );
+	auto scaling = QTransform::fromScale( size.width() / double(source.width()), size.height() / double(source.height()) );
+	painter.setTransform( scaling * transform );
+	painter.drawImage( 0, 0, source );
+}
+
+/* @return Maps the frame scaled to the zoom, but not oriented yet, to the widget */
+QTransform imageViewer::display_transform() const{
+	return orient_transform( unoriented( zoom.size() ) ) * QTransform::fromTranslate( zoom.pos().x(), zoom.pos().y() );
+}
+
+/* @return 'area' of the widget in the frame scaled to the zoom, but not oriented yet */
+QRect imageViewer::scaled_area( QRect area ) const{
+	auto scaled = display_transform().inverted().mapRect( QRectF( area ) ).toAlignedRect();
+	return scaled & QRect( QPoint(), unoriented( zoom.size() ) );
+}
+
+/* Makes the tiles for 'area' which are missing, and forgets those far outside of 'keep'.
+ * Returns false if no tiles are used, as it is zoomed in or they are still being refined.
+ * Zoomed in images are drawn directly, as a scaled version would be huge. */
+bool imageViewer::update_tiles( const QImage& frame, const MipChain& mipmaps, QRect area, QRect keep ){
+	auto wanted = unoriented( zoom.size() );
+	if( wanted.width() > frame.width() || wanted.height() > frame.height() || wanted == frame.size() ){
+		tiles.clear();
+		return false;
+	}
+	
+	//Resampling can't keep up with zooming, only use what is there until it stops
+	auto& source = mipmaps.level( frame, wanted );
+	if( interacting || refine_watcher->isRunning() )
+		if( !tiles.isFor( source, wanted ) || !tiles.missing( area ).empty() )
+			return false;
+	
+	//Otherwise make what is missing right away, which is only a strip of tiles when panning
+	tiles.reset( source, wanted );
+	auto missing = tiles.missing( area );
+	if( !missing.empty() )
+		tiles.add( DisplayTiles::render( source, wanted, missing, downscale_filter ) );
+	
+	tiles.trim( keep.adjusted( -DisplayTiles::tile_size, -DisplayTiles::tile_size, DisplayTiles::tile_size, DisplayTiles::tile_size ) );
+	return true;
+}
+
+void imageViewer::start_interaction(){
+	interacting = true;
+	refine_timer->start();
+}
+
+/* Input stopped, make the tiles in view for the current zoom in the background */
+void imageViewer::refine(){
+	interacting = false;
+	if( refine_watcher->isRunning() )
+		return; //Checked again once it is done
 	
-	painter.drawImage( zoom.area(), get_frame() );
+	auto wanted = unoriented( zoom.size() );
+	if( shown.isNull() || wanted.width() > shown.width() || wanted.height() > shown.height() || wanted == shown.size() ){
+		update(); //No tiles are used, just draw it smoothly again
+		return;
+	}
+	
+	auto source = shown_mipmaps.level( shown, wanted );
+	tiles.reset( source, wanted );
+	auto missing = tiles.missing( scaled_area( rect() ) );
+	if( missing.empty() )
+		return;
+	
+	auto filter = downscale_filter;
+	refine_source = source;
+	refine_size = wanted;
+	refine_watcher->setFuture( QtConcurrent::run( [=](){ return DisplayTiles::render( source, wanted, missing, filter ); } ) );
+}
+
+void imageViewer::refine_finished(){
+	//The zoom or frame might have changed while it was running
+	if( tiles.isFor( refine_source, refine_size ) ){
+		tiles.add( refine_watcher->result() );
+		update();
+	}
+	else if( !interacting )
+		refine();
+	refine_source = QImage();
 }
 
 QSize imageViewer::sizeHint() const{
@@ -459,6 +855,8 @@ void imageViewer::mousePressEvent( QMouseEvent *event ){
 	
 	mouse_active |= event->button();
 	mouse_last_pos = event->pos();
+	stop_kinetic();
+	pan_clock.start();
 	
 	//Change cursor when dragging
 	if( event->button() == button_drag )
@@ -511,18 +909,62 @@ void imageViewer::mouseMoveEvent( QMouseEvent *event ){
 			mouse_last_pos = event->pos();
 		}
 		
-		if( zoom.move( event->pos() - mouse_last_pos ) ){
-			restrict_view();
-			update();
-		}
+		auto offset = event->pos() - mouse_last_pos;
+		pan( offset );
 		mouse_last_pos = event->pos();
+		
+		//Follow the speed of the last few moves
+		auto elapsed = pan_clock.restart();
+		if( elapsed > 0 )
+			pan_velocity = pan_velocity * 0.2 + QPointF( offset ) / elapsed * 0.8;
 	}
 }
 
+/* Moves the image, only the parts which were not visible before are repainted */
+bool imageViewer::pan( QPoint offset ){
+	auto old_pos = zoom.pos();
+	if( zoom.move( offset ) )
+		restrict_view();
+	
+	auto moved = zoom.pos() - old_pos;
+	if( moved.isNull() )
+		return false;
+	scroll( moved.x(), moved.y() );
+	return true;
+}
+
+void imageViewer::stop_kinetic(){
+	kinetic_timer->stop();
+	pan_velocity = {};
+	pan_remainder = {};
+}
+
+void imageViewer::kinetic_step(){
+	//Slow down exponentially, about a third of a second to lose most of the speed
+	auto elapsed = pan_clock.restart();
+	pan_velocity *= std::exp( -elapsed / 325.0 );
+	pan_remainder += pan_velocity * elapsed;
+	
+	auto offset = pan_remainder.toPoint();
+	pan_remainder -= offset;
+	
+	//Stop once it is too slow to notice, or it can't move any further
+	bool too_slow = std::hypot( pan_velocity.x(), pan_velocity.y() ) < 0.02;
+	if( too_slow || ( !offset.isNull() && !pan( offset ) ) )
+		stop_kinetic();
+}
+
 
 void imageViewer::mouseReleaseEvent( QMouseEvent *event ){
 	setCursor( ( (mouse_active & button_drag) && zoom.moveable(size()) ) ? Qt::OpenHandCursor : Qt::ArrowCursor );
 	
+	//Keep panning if it was still moving when released
+	if( kinetic_panning && event->button() == button_drag && !is_zooming && !multi_button
+		&&	pan_clock.isValid() && pan_clock.elapsed() < 50 && !pan_velocity.isNull() ){
+		pan_clock.restart();
+		kinetic_timer->start();
+	}
+	
 	//If only one button was pressed
 	if( !multi_button ){
 		if( event->button() == button_scaling ){
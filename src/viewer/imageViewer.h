@@ -22,15 +22,25 @@
 #include <QColor>
 #include <QSettings>
 #include <QContextMenuEvent>
+#include <QPointer>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 
+#include <ctime>
+#include <map>
 #include <memory>
 
+#include "DisplayTiles.hpp"
+#include "FrameRing.hpp"
+#include "MipChain.hpp"
 #include "Orientation.hpp"
 #include "ZoomBox.hpp"
 
 class imageCache;
 
 class QStaticText;
+class QScreen;
+class QWindow;
 
 class imageViewer: public QWidget{
 	Q_OBJECT
@@ -42,25 +52,106 @@ class imageViewer: public QWidget{
 		int loop_counter{ 0 };
 		bool continue_animating{ false };
 		int waiting_on_frame{ -1 };
+		bool size_initialised{ false }; //init_size() has been done for this image
+		
+		//Frames are shown at fixed times on a timeline, so the time spent on each doesn't add up
+		QElapsedTimer timeline;
+		qint64 frame_due{ 0 }; //When the current frame was to be shown on the timeline, in ms
+		int frames_shown{ 0 };
+		int frames_dropped{ 0 };
+		bool log_fps;
+		qint64 timeline_paused{ 0 }; //Time the timeline has been paused, in ms
+		qint64 timeline_now() const{ return timeline.elapsed() - timeline_paused; }
+		void restart_timeline();
+		void update_changes();
 	public:
 		int get_frame_amount() const{ return frame_amount; }
 		int get_current_frame() const{ return current_frame; }
 		bool can_animate() const;
 		bool is_animating() const{ return continue_animating; }
 	
-	//Color managed cache
+	//Color managed cache, frames are prepared in the background when loading
 	private:
-		QImage converted;
-		int converted_monitor{ -1 };
-		void clear_converted(){
-			converted = QImage();
-			converted_monitor = -1;
-		}
+		struct ConvertedFrame{
+			QImage image;
+			MipChain mipmaps;
+			int frame{ -1 };
+		};
+		static const unsigned max_converted = 2; //Enough for moving between two monitors
+		std::map<int,ConvertedFrame> converted; //Keyed by monitor
+		QImage shown; //Kept until the next frame has been prepared
+		MipChain shown_mipmaps;
+		int shown_frame{ -1 };
+		int monitor{ -1 }; //The monitor this viewer is shown on
+		int previous_monitor{ -1 }; //The monitor it was on before, its frames are kept
+		QPointer<QWindow> watched_window;
+		void clear_converted(){ converted.clear(); }
+		QImage converted_frame();
+		void watch_window();
+	private slots:
+		void screen_changed( QScreen* screen );
+	
+	//Animations are paused while the window can not be seen, CPU time is logged for both
+	private:
+		bool pause_hidden;
+		bool log_cpu;
+		bool hidden{ false };
+		qint64 hidden_since{ 0 }; //On the timeline
+		QElapsedTimer visibility_clock;
+		std::clock_t visibility_cpu{ 0 };
+		bool paused() const{ return hidden && pause_hidden; }
+	protected:
+		bool eventFilter( QObject* watched, QEvent* event ) override;
+	private slots:
+		void window_visibility();
+	
+	//The frame scaled to the current zoom, made in tiles as they come into view
+	private:
+		DisplayTiles tiles;
+		ResampleFilter downscale_filter;
+		QTransform display_transform() const;
+		QRect scaled_area( QRect area ) const;
+		bool update_tiles( const QImage& frame, const MipChain& mipmaps, QRect area, QRect keep );
+	
+	//While zooming only a cheap preview is drawn, the tiles are made once idle
+	private:
+		QTimer* refine_timer;
+		QFutureWatcher<std::vector<DisplayTiles::Tile>>* refine_watcher;
+		QImage refine_source; //The level the tiles are being made from
+		QSize refine_size;
+		bool interacting{ false };
+		void start_interaction();
+	private slots:
+		void refine();
+		void refine_finished();
+	
+	//Panning moves what has been drawn already, and keeps going after the release
+	private:
+		bool kinetic_panning;
+		QTimer* kinetic_timer;
+		QElapsedTimer pan_clock;
+		QPointF pan_velocity;  //In pixels per ms
+		QPointF pan_remainder; //Movement less than a pixel, not applied yet
+		bool pan( QPoint offset );
+		void stop_kinetic();
+	private slots:
+		void kinetic_step();
+	
+	//Animation frames scaled to the zoom ahead of the playhead, so playback only has to draw them
+	private:
+		FrameRing ring;
+		QFutureWatcher<std::vector<FrameRing::Frame>>* ring_watcher;
+		std::weak_ptr<imageCache> ring_image; //The image being scaled by ring_watcher, a new one could reuse its address
+		void fill_ring();
+	private slots:
+		void ring_filled();
 	
-	//How the image is to be viewed
+	//How the image is to be viewed, the frames are oriented when drawn
 	private:
 		ZoomBox zoom;
 		Orientation orientation;
+		QTransform orient_transform( QSize frame_size ) const;
+		QSize unoriented( QSize oriented ) const;
 		
 	//Settings to autoscale
 	private:
@@ -85,9 +176,11 @@ class imageViewer: public QWidget{
 	private slots:
 		void read_info();
 		void check_frame( unsigned int idx );
+		void check_prepared( unsigned int idx );
 	private slots:
 		void change_frame( int frame );
 		void next_frame(){ change_frame( current_frame + 1 ); }
+		void animation_tick();
 	public slots:
 		void goto_frame( int idx );
 		void goto_next_frame(){ goto_frame( current_frame + 1); }
@@ -102,10 +195,11 @@ class imageViewer: public QWidget{
 		void mirrorVer(){ mirror( false, true ); }
 	
 	protected:
-		void updateOrientation( Orientation wanted, Orientation current );
 		void draw_message( QStaticText* text );
-		void paintEvent( QPaintEvent* );
+		void paintEvent( QPaintEvent* event );
+		void showEvent( QShowEvent* ){ watch_window(); }
 		void resizeEvent( QResizeEvent* ){
+			start_interaction();
 			if( auto_scale_on )
 				auto_zoom();
 			else
@@ -152,6 +246,8 @@ class imageViewer: public QWidget{
 	
 	signals:
 		void image_info_read();
+		void monitor_changed( int monitor );
+		void visibility_changed( bool visible );
 		void resize_wanted();
 		void image_changed();
 		void double_clicked();